@@ -1,6 +1,7 @@
 #include <ctime>
 #include <iostream>
 #include <multimethods.h>
+#include "perf_counters.h"
 using namespace std;
 
 struct base { virtual ~base() {} };
@@ -18,6 +19,8 @@ int main() {
     asteroid a;
     spaceship s;
 
+    perf_counters counters;
+    counters.start();
     clock_t begin = clock();
 
     for(int i = 0; i < 250000000; ++i) {
@@ -28,5 +31,7 @@ int main() {
     }
 
     const double ms = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
     printf("%f\n", ms);
+    counters.report("dynamic_cast", 1e9);
 }
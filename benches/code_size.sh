@@ -0,0 +1,47 @@
+#!/bin/sh
+# Measures code size of multimethods with synthetic programs (see generate.cmake): the size of
+# a multimethod and of an implementation, found from programs that differ only in the count
+# of multimethods or of implementations. Prints CSV to stdout:
+#
+#   CXX=g++ CXXFLAGS=-O2 benches/code_size.sh
+#
+# where text_bytes are sizes of read-only sections (code, tables, unwinding info) and file_bytes
+# are sizes of stripped programs.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+CXX=${CXX:-clang++}
+CXXFLAGS=${CXXFLAGS:--O2}
+OUT=${OUT:-/tmp/multimethods-size}
+METHODS=${METHODS:-101}
+IMPLS=${IMPLS:-9}
+
+mkdir -p "$OUT"
+
+# build <name> <cmake definitions...>, prints 'text_bytes file_bytes'
+build() {
+    name=$1
+    shift
+
+    cmake -DOUTPUT="$OUT/$name.cpp" -DCLASSES=64 -DDEPTH=4 -DWIDTH=4 "$@" -P benches/generate.cmake > /dev/null
+    $CXX -std=c++17 $CXXFLAGS -I. "$OUT/$name.cpp" -o "$OUT/$name" 2> "$OUT/$name.log"
+    strip "$OUT/$name"
+
+    echo "$(size "$OUT/$name" | awk 'NR == 2 { print $1 }') $(wc -c < "$OUT/$name")"
+}
+
+set -- $(build base -DMETHODS=1 -DIMPLS=1) \
+       $(build methods -DMETHODS="$METHODS" -DIMPLS=1) \
+       $(build impls -DMETHODS="$METHODS" -DIMPLS="$IMPLS")
+
+echo "program,methods,impls,text_bytes,file_bytes"
+echo "base,1,1,$1,$2"
+echo "methods,$METHODS,1,$3,$4"
+echo "impls,$METHODS,$IMPLS,$5,$6"
+echo
+echo "text_bytes_per_method,text_bytes_per_impl,file_bytes_per_method,file_bytes_per_impl"
+echo "$1 $2 $3 $4 $5 $6" | awk -v m="$METHODS" -v i="$IMPLS" '{
+    printf "%.0f,%.0f,%.0f,%.0f\n", ($3 - $1) / (m - 1), ($5 - $3) / (m * (i - 1)), ($4 - $2) / (m - 1), ($6 - $4) / (m * (i - 1))
+}'
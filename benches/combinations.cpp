@@ -0,0 +1,101 @@
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct thing { virtual ~thing() {} long shields = 0, checks = 0; };
+struct asteroid : thing {};
+struct spaceship : thing {};
+struct station : thing {};
+struct debris : asteroid {};
+
+static long g_log = 0;
+
+// Primary implementations only
+int multi_method(hit_plain, thing&, thing&)
+    match(asteroid&, spaceship&) { return 2; }
+    match(thing&, thing&) { return 1; }
+end_method
+
+// Before implementations emulated with 'next_method', after ones with a call of another method
+void multi_method(log_emulated, thing&, thing&)
+    match(thing&, thing&) { ++g_log; }
+end_method
+
+int multi_method(hit_emulated, thing&, thing&)
+    match(spaceship& s, thing&) { ++s.shields; next_method; }
+    match(thing&, asteroid& a) { ++a.checks; next_method; }
+    match(asteroid& a, spaceship& s) { log_emulated(a, s); return 2; }
+    match(thing& a, thing& b) { log_emulated(a, b); return 1; }
+end_method
+
+// The same with qualified implementations
+int multi_method(hit_combined, thing&, thing&)
+    match(asteroid&, spaceship&) { return 2; }
+    match(thing&, thing&) { return 1; }
+    match_before(spaceship& s, thing&) { ++s.shields; }
+    match_before(thing&, asteroid& a) { ++a.checks; }
+    match_after(thing&, thing&) { ++g_log; }
+end_method
+
+static unique_ptr<thing> make_thing(unsigned n) {
+    switch(n % 4) {
+        case 0: return make_unique<asteroid>();
+        case 1: return make_unique<spaceship>();
+        case 2: return make_unique<station>();
+    }
+    return make_unique<debris>();
+}
+
+template<class F>
+static double measure(const char* label, int calls, F f) {
+    perf_counters counters;
+    counters.start();
+    const clock_t begin = clock();
+    const long r = f();
+    const double seconds = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report(label, calls);
+    cerr << label << " checksum: " << r << '\n';
+    return seconds * 1e9 / calls;
+}
+
+// Calls of a method with befores and an after for pairs of random objects: emulated with
+// 'next_method' and a call of another multimethod, and with qualified implementations;
+// calls of the primary implementations alone for reference:
+//
+//   combinations [calls]
+//
+int main(int argc, char** argv) {
+    const int calls = argc > 1 ? atoi(argv[1]) : 20000000;
+    mt19937 rnd(1);
+
+    vector<unique_ptr<thing>> objects;
+    for(int i = 0 ; i < 1024 ; ++i) {
+        objects.push_back(make_thing(rnd()));
+    }
+
+    const auto run = [&](auto method) {
+        long sum = 0;
+        for(int i = 0 ; i < calls ; ++i) {
+            sum += method(*objects[i & 1023], *objects[(i * 7 + 3) & 1023]);
+        }
+        for(auto& it : objects) {
+            sum += it->shields + it->checks;
+            it->shields = it->checks = 0;
+        }
+        sum += g_log;
+        g_log = 0;
+        return sum;
+    };
+
+    const double plain = measure("plain", calls, [&] { return run(MM_METHOD(hit_plain)); });
+    const double emulated = measure("emulated", calls, [&] { return run(MM_METHOD(hit_emulated)); });
+    const double combined = measure("combined", calls, [&] { return run(MM_METHOD(hit_combined)); });
+
+    printf("plain_ns,emulated_ns,combined_ns\n%.2f,%.2f,%.2f\n", plain, emulated, combined);
+}
@@ -0,0 +1,109 @@
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct thing { virtual ~thing() {} };
+struct asteroid : thing {};
+struct spaceship : thing {};
+struct station : thing {};
+struct debris : asteroid {};
+
+int multi_method(collide, thing&, thing&)
+    match(asteroid&, asteroid&) { return 1; }
+    match(asteroid&, spaceship&) { return 2; }
+    match(spaceship&, asteroid&) { return 3; }
+    match(spaceship&, spaceship&) { return 4; }
+    match(station&, thing&) { return 5; }
+    match(thing&, station&) { return 6; }
+end_method
+
+int multi_method(resolve_damage, const thing&, const thing&)
+    match(const asteroid&, const spaceship&) { return 10; }
+    match(const spaceship&, const asteroid&) { return 20; }
+    match(const debris&, const thing&) { return 30; }
+    match(const thing&, const thing&) { return 0; }
+end_method
+
+int multi_method(play_sound, thing&, thing&)
+    match(spaceship&, spaceship&) { return 100; }
+    match(station&, station&) { return 200; }
+    match(thing&, thing&) { return 0; }
+end_method
+
+static unique_ptr<thing> make_thing(unsigned n) {
+    switch(n % 4) {
+        case 0: return make_unique<asteroid>();
+        case 1: return make_unique<spaceship>();
+        case 2: return make_unique<station>();
+    }
+    return make_unique<debris>();
+}
+
+// Three multimethods are called for each pair of objects, with ordinary calls, with
+// a dispatch context that identifies dynamic types of the pair once, and with contexts of
+// 1024 pairs kept between rounds, which select implementations on the first round only:
+//
+//   context [pairs]
+//
+int main(int argc, char** argv) {
+    const int pairs = argc > 1 ? atoi(argv[1]) : 50000000;
+    mt19937 rnd(1);
+
+    vector<unique_ptr<thing>> objects;
+    for(int i = 0 ; i < 1024 ; ++i) {
+        objects.push_back(make_thing(rnd()));
+    }
+
+    perf_counters counters;
+    long sum1 = 0, sum2 = 0;
+
+    counters.start();
+    clock_t begin = clock();
+    for(int i = 0 ; i < pairs ; ++i) {
+        thing& a = *objects[i & 1023];
+        thing& b = *objects[(i * 7 + 3) & 1023];
+        sum1 += collide(a, b) + resolve_damage(a, b) + play_sound(a, b);
+    }
+    const double calls = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report("calls", pairs);
+
+    counters.start();
+    begin = clock();
+    for(int i = 0 ; i < pairs ; ++i) {
+        multimethods::dispatch_context ctx(*objects[i & 1023], *objects[(i * 7 + 3) & 1023]);
+        sum2 += collide(ctx) + resolve_damage(ctx) + play_sound(ctx);
+    }
+    const double context = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report("context", pairs);
+
+    using context_t = multimethods::dispatch_context<thing, thing>;
+    vector<context_t> contexts;
+    for(int i = 0 ; i < 1024 ; ++i) {
+        contexts.emplace_back(*objects[i & 1023], *objects[(i * 7 + 3) & 1023]);
+    }
+
+    long sum3 = 0;
+    counters.start();
+    begin = clock();
+    for(int i = 0 ; i < pairs ; ++i) {
+        const context_t& ctx = contexts[i & 1023];
+        sum3 += collide(ctx) + resolve_damage(ctx) + play_sound(ctx);
+    }
+    const double reused = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report("reused context", pairs);
+
+    if(sum1 != sum2 || sum1 != sum3) {
+        printf("Results differ\n");
+        return 1;
+    }
+
+    printf("calls_ns,context_ns,reused_context_ns\n%.2f,%.2f,%.2f\n", calls * 1e9 / pairs, context * 1e9 / pairs, reused * 1e9 / pairs);
+}
@@ -0,0 +1,267 @@
+# Generates a benchmark with a synthetic hierarchy of classes and multimethods:
+#
+#   cmake -DOUTPUT=synthetic.cpp [-DWIDTH=2] [-DDEPTH=10] [-DCLASSES=1200] [-DMULTIPLE=0] [-DVIRTUAL=0]
+#         [-DMM_CLASS=0] [-DMETHODS=300] [-DARITY=2] [-DIMPLS=16] [-DSEED=1] -P benches/generate.cmake
+#
+# WIDTH     - count of derived classes of each class
+# DEPTH     - count of levels of the hierarchy
+# CLASSES   - maximal count of classes (levels are filled from the root)
+# MULTIPLE  - each class also inherits an interface, or with VIRTUAL - a class of parent's level
+# VIRTUAL   - virtual inheritance
+# MM_CLASS  - use MM_CLASS macro (not compatible with VIRTUAL)
+# METHODS   - count of multimethods
+# ARITY     - count of parameters of multimethods
+# IMPLS     - count of implementations of each multimethod (including one for root classes)
+#
+# Generated program runs as 'synthetic [calls]' and prints:
+#
+#   init_us,first_call_ns,call_ns,rss_init_kb,rss_kb,cycles,instructions,branch_misses,l1d_misses,l1i_misses
+#
+# where init_us is time of static initialization, first_call_ns is average time of the first call
+# of each multimethod, call_ns is average time of a call with random objects. Hardware counters
+# are per call with random objects (see benches/perf_counters.h), empty if not available.
+# The program must be compiled with the root of the repository in include paths.
+
+cmake_minimum_required(VERSION 3.5)
+
+macro(mm_default name value)
+    if(NOT DEFINED ${name})
+        set(${name} ${value})
+    endif()
+endmacro()
+
+mm_default(OUTPUT synthetic.cpp)
+mm_default(WIDTH 2)
+mm_default(DEPTH 10)
+mm_default(CLASSES 1200)
+mm_default(MULTIPLE 0)
+mm_default(VIRTUAL 0)
+mm_default(MM_CLASS 0)
+mm_default(METHODS 300)
+mm_default(ARITY 2)
+mm_default(IMPLS 16)
+mm_default(SEED 1)
+
+if(ARITY LESS 1 OR ARITY GREATER 6)
+    message(FATAL_ERROR "ARITY must be from 1 to 6.")
+endif()
+if(IMPLS LESS 1 OR IMPLS GREATER 64)
+    message(FATAL_ERROR "IMPLS must be from 1 to 64.")
+endif()
+if(METHODS LESS 1 OR CLASSES LESS 1 OR DEPTH LESS 1)
+    message(FATAL_ERROR "METHODS, CLASSES and DEPTH must be positive.")
+endif()
+if(VIRTUAL AND MM_CLASS)
+    message(FATAL_ERROR "MM_CLASS doesn't support virtual inheritance.")
+endif()
+
+# Linear congruential generator, to get the same program for the same parameters
+set(mm_seed ${SEED})
+macro(mm_random out limit)
+    math(EXPR mm_seed "(${mm_seed} * 1103515245 + 12345) % 2147483648")
+    math(EXPR ${out} "(${mm_seed} / 65536) % (${limit})")
+endmacro()
+
+# Hierarchy, breadth-first
+set(levels 0)
+set(parents -1)
+set(level_0 0)
+set(count 1)
+set(pos 0)
+while(pos LESS count AND count LESS CLASSES)
+    list(GET levels ${pos} level)
+    math(EXPR next "${level} + 1")
+    if(next LESS DEPTH)
+        foreach(k RANGE 1 ${WIDTH})
+            if(count LESS CLASSES)
+                list(APPEND levels ${next})
+                list(APPEND parents ${pos})
+                list(APPEND level_${next} ${count})
+                math(EXPR count "${count} + 1")
+            endif()
+        endforeach()
+    endif()
+    math(EXPR pos "${pos} + 1")
+endwhile()
+
+set(mixins 8)
+set(inherit "")
+if(VIRTUAL)
+    set(inherit "virtual ")
+endif()
+
+set(code "// Generated by benches/generate.cmake: WIDTH=${WIDTH} DEPTH=${DEPTH} CLASSES=${CLASSES} MULTIPLE=${MULTIPLE} VIRTUAL=${VIRTUAL}\n")
+string(APPEND code "// MM_CLASS=${MM_CLASS} METHODS=${METHODS} ARITY=${ARITY} IMPLS=${IMPLS} SEED=${SEED}\n\n")
+string(APPEND code "#include <chrono>\n\n")
+string(APPEND code "inline const auto g_init_begin = std::chrono::steady_clock::now();\n\n")
+string(APPEND code "#include <cstdio>\n#include <cstdlib>\n#include <random>\n#include <vector>\n#include <sys/resource.h>\n#include <multimethods.h>\n#include <benches/perf_counters.h>\n")
+string(APPEND code "using namespace std;\n\n")
+
+# Classes
+if(MULTIPLE AND NOT VIRTUAL)
+    math(EXPR last "${mixins} - 1")
+    foreach(i RANGE ${last})
+        string(APPEND code "struct mixin${i} { virtual ~mixin${i}() {} int m${i} = ${i}; };\n")
+    endforeach()
+    string(APPEND code "\n")
+endif()
+
+if(MM_CLASS)
+    string(APPEND code "struct c0 { MM_CLASS() virtual ~c0() {} };\n")
+else()
+    string(APPEND code "struct c0 { virtual ~c0() {} };\n")
+endif()
+
+math(EXPR last "${count} - 1")
+if(last GREATER 0)
+    foreach(i RANGE 1 ${last})
+        list(GET parents ${i} parent)
+        list(GET levels ${parent} level)
+        set(bases "${inherit}c${parent}")
+
+        if(MULTIPLE AND VIRTUAL)
+            list(LENGTH level_${level} n)
+            if(n GREATER 1)
+                mm_random(k ${n})
+                list(GET level_${level} ${k} other)
+                if(NOT other EQUAL parent)
+                    string(APPEND bases ", virtual c${other}")
+                endif()
+            endif()
+        elseif(MULTIPLE)
+            math(EXPR k "${i} % ${mixins}")
+            string(APPEND bases ", mixin${k}")
+        endif()
+
+        if(MM_CLASS)
+            string(APPEND code "struct c${i} : ${bases} { MM_CLASS(c${parent}) };\n")
+        else()
+            string(APPEND code "struct c${i} : ${bases} {};\n")
+        endif()
+    endforeach()
+endif()
+
+# Multimethods, the first implementation for root classes makes every call valid
+set(params "c0&")
+set(args "*a[0]")
+math(EXPR last_arg "${ARITY} - 1")
+if(last_arg GREATER 0)
+    foreach(k RANGE 1 ${last_arg})
+        string(APPEND params ", c0&")
+        string(APPEND args ", *a[${k}]")
+    endforeach()
+endif()
+
+math(EXPR last_method "${METHODS} - 1")
+foreach(m RANGE ${last_method})
+    string(APPEND code "\nint multi_method(mm${m}, ${params})\n")
+    string(APPEND code "    match(${params}) { return 0; }\n")
+
+    set(signatures "${params}")
+    set(impl 1)
+    set(attempts 0)
+    while(impl LESS IMPLS AND attempts LESS 1000)
+        mm_random(t ${count})
+        set(signature "c${t}&")
+        if(last_arg GREATER 0)
+            foreach(k RANGE 1 ${last_arg})
+                mm_random(t ${count})
+                string(APPEND signature ", c${t}&")
+            endforeach()
+        endif()
+
+        list(FIND signatures "${signature}" found)
+        if(found LESS 0)
+            list(APPEND signatures "${signature}")
+            string(APPEND code "    match(${signature}) { return ${impl}; }\n")
+            math(EXPR impl "${impl} + 1")
+        endif()
+        math(EXPR attempts "${attempts} + 1")
+    endwhile()
+
+    string(APPEND code "end_method\n")
+endforeach()
+
+# Tables for the driver
+string(APPEND code "\n")
+foreach(m RANGE ${last_method})
+    string(APPEND code "static int call_mm${m}(c0** a) { return mm${m}(${args}); }\n")
+endforeach()
+
+string(APPEND code "\nstatic int (*const g_calls[])(c0**) = {\n")
+foreach(m RANGE ${last_method})
+    string(APPEND code "    call_mm${m},\n")
+endforeach()
+string(APPEND code "};\n\nstatic c0* make_object(int n) {\n    switch(n) {\n")
+foreach(i RANGE ${last})
+    string(APPEND code "        case ${i}: return new c${i};\n")
+endforeach()
+string(APPEND code "    }\n    return nullptr;\n}\n\n")
+
+string(APPEND code "static const int g_classes = ${count};\n")
+string(APPEND code "static const int g_methods = ${METHODS};\n")
+string(APPEND code "static const int g_arity = ${ARITY};\n")
+
+string(APPEND code [=[
+
+static long rss_kb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char** argv) {
+    using clock = chrono::steady_clock;
+
+    const auto started = clock::now();
+    const long rss_init = rss_kb();
+    const long calls = argc > 1 ? atol(argv[1]) : 10000000;
+
+    vector<c0*> objects;
+    for(int i = 0 ; i < g_classes ; ++i) {
+        objects.push_back(make_object(i));
+    }
+
+    // Random calls, with each multimethod called first in the beginning
+    const int tuples = 4096;
+    mt19937 rnd(1);
+    vector<c0*> args(tuples * g_arity);
+    vector<int> methods(tuples);
+    for(int i = 0 ; i < tuples ; ++i) {
+        methods[i] = i < g_methods ? i : int(rnd() % g_methods);
+        for(int k = 0 ; k < g_arity ; ++k) {
+            args[i * g_arity + k] = objects[rnd() % g_classes];
+        }
+    }
+
+    int sink = 0;
+    const int first = g_methods < tuples ? g_methods : tuples;
+    const auto first_begin = clock::now();
+    for(int i = 0 ; i < first ; ++i) {
+        sink += g_calls[methods[i]](&args[i * g_arity]);
+    }
+    const auto first_end = clock::now();
+
+    perf_counters counters;
+    counters.start();
+    for(long i = 0 ; i < calls ; ++i) {
+        const int j = int(i & (tuples - 1));
+        sink += g_calls[methods[j]](&args[j * g_arity]);
+    }
+    const auto end = clock::now();
+    counters.stop();
+
+    printf("%.1f,%.1f,%.2f,%ld,%ld",
+           chrono::duration<double, micro>(started - g_init_begin).count(),
+           chrono::duration<double, nano>(first_end - first_begin).count() / first,
+           chrono::duration<double, nano>(end - first_end).count() / (calls > 0 ? calls : 1),
+           rss_init, rss_kb());
+    counters.csv(double(calls > 0 ? calls : 1));
+    printf("\n");
+
+    return sink == -1;
+}
+]=])
+
+file(WRITE "${OUTPUT}" "${code}")
+message(STATUS "${OUTPUT}: ${count} classes, ${METHODS} multimethods")
@@ -0,0 +1,54 @@
+#include <ctime>
+#include <iostream>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct thing { virtual ~thing() {} };
+struct asteroid final : thing {};
+struct spaceship final : thing {};
+
+int multi_method(collide, thing&, thing&)
+    match(asteroid&, asteroid&) { return 1; }
+    match(asteroid&, spaceship&) { return 2; }
+    match(spaceship&, asteroid&) { return 3; }
+    match(spaceship&, spaceship&) { return 4; }
+end_method
+
+// Calls a multimethod in a loop with the same types of arguments, with dispatch on each call
+// and with a pre-resolved handle (build with -DNDEBUG to skip checks of types in handles).
+//
+int main() {
+    asteroid a;
+    spaceship s;
+    const int calls = 100000000;
+    long sum1 = 0, sum2 = 0;
+    perf_counters counters;
+
+    counters.start();
+    clock_t begin = clock();
+    for(int i = 0 ; i < calls ; ++i) {
+        sum1 += collide(a, s);
+    }
+    const double call = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report("call", calls);
+
+    const auto h = multimethods::resolve(MM_METHOD(collide), a, s);
+
+    counters.start();
+    begin = clock();
+    for(int i = 0 ; i < calls ; ++i) {
+        sum2 += h(a, s);
+    }
+    const double handle = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report("handle", calls);
+
+    if(sum1 != sum2) {
+        printf("Results differ\n");
+        return 1;
+    }
+
+    printf("call_ns,handle_ns\n%.2f,%.2f\n", call * 1e9 / calls, handle * 1e9 / calls);
+}
@@ -0,0 +1,99 @@
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct thing { virtual ~thing() {} };
+struct asteroid : thing {};
+struct spaceship : thing {};
+struct station : thing {};
+struct debris : asteroid {};
+
+int multi_method(collide, thing&, thing&)
+    match(asteroid&, asteroid&) { return 1; }
+    match(asteroid&, spaceship&) { return 2; }
+    match(spaceship&, asteroid&) { return 3; }
+    match(spaceship&, spaceship&) { return 4; }
+    match(station&, thing&) { return 5; }
+    match(thing&, station&) { return 6; }
+    match(debris&, thing&) { return 7; }
+end_method
+
+static unique_ptr<thing> make_thing(unsigned n) {
+    switch(n % 4) {
+        case 0: return make_unique<asteroid>();
+        case 1: return make_unique<spaceship>();
+        case 2: return make_unique<station>();
+    }
+    return make_unique<debris>();
+}
+
+// Objects are split into spatial buckets, every bucket checks all pairs of its objects:
+//
+//   pairs [bucket size]
+//
+int main(int argc, char** argv) {
+    const size_t bucket = argc > 1 ? size_t(atoi(argv[1])) : 64;
+    mt19937 rnd(1);
+
+    perf_counters counters;
+    char label[64];
+
+    printf("objects,pairs,loop_ns,for_each_pair_ns\n");
+
+    for(size_t count : { 1000, 10000, 100000 }) {
+        vector<unique_ptr<thing>> objects;
+        for(size_t i = 0 ; i < count ; ++i) {
+            objects.push_back(make_thing(rnd()));
+        }
+
+        vector<vector<thing*>> buckets((count + bucket - 1) / bucket);
+        for(size_t i = 0 ; i < count ; ++i) {
+            buckets[i / bucket].push_back(objects[i].get());
+        }
+
+        // Repeat small sets to get comparable times
+        const int rounds = int(100000 / count);
+        long pairs = 0, sum1 = 0, sum2 = 0;
+
+        counters.start();
+        clock_t begin = clock();
+        for(int r = 0 ; r < rounds ; ++r) {
+            for(auto& b : buckets) {
+                for(thing* x : b) {
+                    for(thing* y : b) {
+                        sum1 += collide(*x, *y);
+                    }
+                }
+                pairs += long(b.size() * b.size());
+            }
+        }
+        const double loop = double(clock() - begin) / CLOCKS_PER_SEC;
+        counters.stop();
+        snprintf(label, sizeof(label), "loop, %zu objects", count);
+        counters.report(label, double(pairs));
+
+        counters.start();
+        begin = clock();
+        for(int r = 0 ; r < rounds ; ++r) {
+            for(auto& b : buckets) {
+                multimethods::for_each_pair(MM_METHOD(collide), b, b, [&](thing&, thing&, int v) { sum2 += v; });
+            }
+        }
+        const double blocks = double(clock() - begin) / CLOCKS_PER_SEC;
+        counters.stop();
+        snprintf(label, sizeof(label), "for_each_pair, %zu objects", count);
+        counters.report(label, double(pairs));
+
+        if(sum1 != sum2) {
+            printf("Results differ\n");
+            return 1;
+        }
+
+        printf("%zu,%ld,%.2f,%.2f\n", count, pairs / rounds, loop * 1e9 / pairs, blocks * 1e9 / pairs);
+    }
+}
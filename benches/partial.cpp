@@ -0,0 +1,96 @@
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct device { virtual ~device() {} };
+struct screen : device {};
+struct printer : device {};
+struct plotter : printer {};
+
+struct shape { virtual ~shape() {} };
+struct circle : shape {};
+struct ellipse : circle {};
+struct rect : shape {};
+struct square : rect {};
+struct polygon : shape {};
+struct triangle : polygon {};
+
+int multi_method(draw, device&, const shape&)
+    match(screen&, const circle&) { return 1; }
+    match(screen&, const ellipse&) { return 2; }
+    match(screen&, const rect&) { return 3; }
+    match(screen&, const polygon&) { return 4; }
+    match(printer&, const circle&) { return 5; }
+    match(printer&, const rect&) { return 6; }
+    match(printer&, const shape&) { return 7; }
+    match(plotter&, const polygon&) { return 8; }
+    match(plotter&, const triangle&) { return 9; }
+    match(device&, const shape&) { return 0; }
+end_method
+
+static unique_ptr<shape> make_shape(unsigned n) {
+    switch(n % 6) {
+        case 0: return make_unique<circle>();
+        case 1: return make_unique<ellipse>();
+        case 2: return make_unique<rect>();
+        case 3: return make_unique<square>();
+        case 4: return make_unique<polygon>();
+    }
+    return make_unique<triangle>();
+}
+
+// Draws shapes of random types on one device, with ordinary calls and with the device bound
+// by 'partial', so calls dispatch only by shapes:
+//
+//   partial [calls]
+//
+int main(int argc, char** argv) {
+    const int calls = argc > 1 ? atoi(argv[1]) : 50000000;
+    mt19937 rnd(1);
+
+    vector<unique_ptr<shape>> shapes;
+    for(int i = 0 ; i < 1024 ; ++i) {
+        shapes.push_back(make_shape(rnd()));
+    }
+
+    printf("device,call_ns,partial_ns\n");
+
+    screen s;
+    plotter p;
+    for(device* dev : { static_cast<device*>(&s), static_cast<device*>(&p) }) {
+        perf_counters counters;
+        long sum1 = 0, sum2 = 0;
+
+        counters.start();
+        clock_t begin = clock();
+        for(int i = 0 ; i < calls ; ++i) {
+            sum1 += draw(*dev, *shapes[i & 1023]);
+        }
+        const double call = double(clock() - begin) / CLOCKS_PER_SEC;
+        counters.stop();
+        counters.report("call", calls);
+
+        const auto d = multimethods::partial(MM_METHOD(draw), *dev);
+
+        counters.start();
+        begin = clock();
+        for(int i = 0 ; i < calls ; ++i) {
+            sum2 += d(*shapes[i & 1023]);
+        }
+        const double partial = double(clock() - begin) / CLOCKS_PER_SEC;
+        counters.stop();
+        counters.report("partial", calls);
+
+        if(sum1 != sum2) {
+            printf("Results differ\n");
+            return 1;
+        }
+
+        printf("%s,%.2f,%.2f\n", dev == &s ? "screen" : "plotter", call * 1e9 / calls, partial * 1e9 / calls);
+    }
+}
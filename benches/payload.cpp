@@ -0,0 +1,92 @@
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct point { float x, y; };
+
+struct shape { virtual ~shape() {} vector<point> points; };
+struct circle : shape {};
+struct rect : shape {};
+struct square : rect {};
+
+// Implementations store the points in a shape, squares are passed to rects by 'next_method'
+
+// Only option before rvalue parameters: values are copied on the call and again for each
+// implementation that is tried.
+void multi_method(store_copy, shape&, vector<point>)
+    match(circle& s, vector<point> p) { s.points = std::move(p); }
+    match(rect& s, vector<point> p) { s.points = std::move(p); }
+    match(square&, vector<point> p) { if(p.empty()) { return; } next_method; }
+end_method
+
+// Value is copied on the call, then moved into the implementation.
+void multi_method(store_value, shape&, vector<point>)
+    match(circle& s, vector<point>&& p) { s.points = std::move(p); }
+    match(rect& s, vector<point>&& p) { s.points = std::move(p); }
+    match(square&, const vector<point>& p) { if(p.empty()) { return; } next_method; }
+end_method
+
+// Value is moved by the caller, no copies.
+void multi_method(store_rvalue, shape&, vector<point>&&)
+    match(circle& s, vector<point>&& p) { s.points = std::move(p); }
+    match(rect& s, vector<point>&& p) { s.points = std::move(p); }
+    match(square&, const vector<point>& p) { if(p.empty()) { return; } next_method; }
+end_method
+
+template<class F>
+static double measure(const char* label, size_t bytes, vector<unique_ptr<shape>>& shapes, int calls, F f) {
+    vector<point> points(bytes / sizeof(point), point { 1, 2 });
+
+    perf_counters counters;
+    counters.start();
+    const clock_t begin = clock();
+    for(int i = 0 ; i < calls ; ++i) {
+        shape& s = *shapes[i % shapes.size()];
+        f(s, points);
+        points.swap(s.points); // Takes points back after moves
+    }
+    const double seconds = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+
+    char text[64];
+    snprintf(text, sizeof(text), "%s, %zu bytes", label, bytes);
+    counters.report(text, calls);
+
+    if(points.size() != bytes / sizeof(point)) {
+        printf("Points are lost\n");
+        exit(1);
+    }
+    return seconds * 1e9 / calls;
+}
+
+// Passes multi-kilobyte payloads through a binary multimethod, by value with implementations
+// that take values and rvalue references, and by rvalue reference.
+//
+int main() {
+    // Squares are rare, 'next_method' throws an exception that costs more than a copy
+    vector<unique_ptr<shape>> shapes;
+    for(int i = 0 ; i < 7 ; ++i) {
+        if(i % 2) {
+            shapes.push_back(make_unique<rect>());
+        } else {
+            shapes.push_back(make_unique<circle>());
+        }
+    }
+    shapes.push_back(make_unique<square>());
+
+    printf("bytes,copy_ns,value_ns,rvalue_ns\n");
+
+    for(size_t bytes : { 1024, 4096, 16384, 65536 }) {
+        const int calls = int(400000000 / bytes);
+
+        const double copy = measure("copy", bytes, shapes, calls, [](shape& s, vector<point>& p) { store_copy(s, p); });
+        const double value = measure("value", bytes, shapes, calls, [](shape& s, vector<point>& p) { store_value(s, p); });
+        const double rvalue = measure("rvalue", bytes, shapes, calls, [](shape& s, vector<point>& p) { store_rvalue(s, std::move(p)); });
+
+        printf("%zu,%.2f,%.2f,%.2f\n", bytes, copy, value, rvalue);
+    }
+}
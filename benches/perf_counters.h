@@ -0,0 +1,143 @@
+#pragma once
+
+// Hardware performance counters for benchmarks (Linux perf_event_open). Counters that can't be
+// opened (other OS, containers, perf_event_paranoid, virtual machines without PMU) are
+// reported as unavailable, benchmarks still measure time:
+//
+//   perf_counters counters;
+//   counters.start();
+//   ... 'n' dispatches ...
+//   counters.stop();
+//   counters.report("dynamic_cast", n);
+//
+// or 'counters.csv(n)' to append values to a CSV line.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+class perf_counters final {
+public:
+    static constexpr int count = 5;
+
+    perf_counters() {
+#ifdef __linux__
+        static const std::uint64_t l1_read_miss =
+            PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+
+        static const struct { std::uint32_t type; std::uint64_t config; } events[count] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | l1_read_miss },
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1I | l1_read_miss },
+        };
+
+        for(int i = 0 ; i < count ; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~perf_counters() {
+#ifdef __linux__
+        for(int fd : fds_) {
+            if(fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool available() const {
+        for(int fd : fds_) {
+            if(fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void start() {
+#ifdef __linux__
+        for(int fd : fds_) {
+            if(fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for(int fd : fds_) {
+            if(fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for(int i = 0 ; i < count ; ++i) {
+            std::uint64_t v = 0;
+            values_[i] = fds_[i] >= 0 && read(fds_[i], &v, sizeof(v)) == sizeof(v) ? double(v) : -1;
+        }
+#endif
+    }
+
+    // Prints counters per dispatch to stderr, so output of benchmarks doesn't change.
+    void report(const char* label, double dispatches) const {
+        if(!available()) {
+            std::fprintf(stderr, "%s: hardware counters are not available\n", label);
+            return;
+        }
+
+        std::fprintf(stderr, "%s, per dispatch:", label);
+        for(int i = 0 ; i < count ; ++i) {
+            if(values_[i] < 0) {
+                std::fprintf(stderr, " %s n/a", names()[i]);
+            } else {
+                std::fprintf(stderr, " %s %.3f", names()[i], values_[i] / dispatches);
+            }
+        }
+        std::fprintf(stderr, "\n");
+    }
+
+    // Appends counters per dispatch to a CSV line, unavailable counters are empty.
+    void csv(double dispatches) const {
+        for(int i = 0 ; i < count ; ++i) {
+            if(values_[i] < 0) {
+                std::printf(",");
+            } else {
+                std::printf(",%.3f", values_[i] / dispatches);
+            }
+        }
+    }
+
+    // Header columns for 'csv'.
+    static const char* const* names() {
+        static const char* const r[count] = { "cycles", "instructions", "branch_misses", "l1d_misses", "l1i_misses" };
+        return r;
+    }
+
+private:
+    int fds_[count] = { -1, -1, -1, -1, -1 };
+    double values_[count] = { -1, -1, -1, -1, -1 };
+};
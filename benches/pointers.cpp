@@ -0,0 +1,100 @@
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct thing { virtual ~thing() {} };
+struct asteroid : thing {};
+struct spaceship : thing {};
+struct station : thing {};
+struct debris : asteroid {};
+
+int multi_method(collide_refs, thing&, thing&)
+    match(asteroid&, asteroid&) { return 1; }
+    match(asteroid&, spaceship&) { return 2; }
+    match(spaceship&, asteroid&) { return 3; }
+    match(thing&, thing&) { return 0; }
+end_method
+
+int multi_method(collide_ptrs, const shared_ptr<thing>&, const shared_ptr<thing>&)
+    match(asteroid&, asteroid&) { return 1; }
+    match(asteroid&, spaceship&) { return 2; }
+    match(spaceship&, asteroid&) { return 3; }
+    match(nullptr_t, const shared_ptr<thing>&) { return 4; }
+    match(const shared_ptr<thing>&, const shared_ptr<thing>&) { return 0; }
+end_method
+
+// The same, but pointers are passed by value
+int multi_method(collide_copies, shared_ptr<thing>, shared_ptr<thing>)
+    match(asteroid&, asteroid&) { return 1; }
+    match(asteroid&, spaceship&) { return 2; }
+    match(spaceship&, asteroid&) { return 3; }
+    match(nullptr_t, const shared_ptr<thing>&) { return 4; }
+    match(const shared_ptr<thing>&, const shared_ptr<thing>&) { return 0; }
+end_method
+
+static shared_ptr<thing> make_thing(unsigned n) {
+    switch(n % 4) {
+        case 0: return make_shared<asteroid>();
+        case 1: return make_shared<spaceship>();
+        case 2: return make_shared<station>();
+    }
+    return make_shared<debris>();
+}
+
+template<class F>
+static double measure(const char* label, int calls, F f) {
+    perf_counters counters;
+    counters.start();
+    const clock_t begin = clock();
+    const long r = f();
+    const double seconds = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report(label, calls);
+    cerr << label << " checksum: " << r << '\n';
+    return seconds * 1e9 / calls;
+}
+
+// Calls of a binary multimethod for pairs of objects held by 'shared_ptr': with references to
+// objects, with pointers by const reference (dispatched by pointees) and with pointers by value
+// (reference counting on each call):
+//
+//   pointers [calls]
+//
+int main(int argc, char** argv) {
+    const int calls = argc > 1 ? atoi(argv[1]) : 50000000;
+    mt19937 rnd(1);
+
+    vector<shared_ptr<thing>> objects;
+    for(int i = 0 ; i < 1024 ; ++i) {
+        objects.push_back(make_thing(rnd()));
+    }
+
+    const double refs = measure("references", calls, [&] {
+        long sum = 0;
+        for(int i = 0 ; i < calls ; ++i) {
+            sum += collide_refs(*objects[i & 1023], *objects[(i * 7 + 3) & 1023]);
+        }
+        return sum;
+    });
+    const double ptrs = measure("pointers", calls, [&] {
+        long sum = 0;
+        for(int i = 0 ; i < calls ; ++i) {
+            sum += collide_ptrs(objects[i & 1023], objects[(i * 7 + 3) & 1023]);
+        }
+        return sum;
+    });
+    const double copies = measure("copies", calls, [&] {
+        long sum = 0;
+        for(int i = 0 ; i < calls ; ++i) {
+            sum += collide_copies(objects[i & 1023], objects[(i * 7 + 3) & 1023]);
+        }
+        return sum;
+    });
+
+    printf("references_ns,pointers_ns,copies_ns\n%.2f,%.2f,%.2f\n", refs, ptrs, copies);
+}
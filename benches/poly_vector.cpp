@@ -0,0 +1,85 @@
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct thing { virtual ~thing() {} float x = 0, v = 1; };
+struct asteroid : thing {};
+struct spaceship : thing { float fuel = 1e9f; };
+struct station : thing {};
+struct debris : asteroid {};
+
+void multi_method(update, thing&, float)
+    match(asteroid& a, float dt) { a.x += a.v * dt; }
+    match(spaceship& s, float dt) { s.x += s.v * dt; s.fuel -= dt; }
+    match(station& s, float dt) { s.v += dt; }
+    match(debris& d, float dt) { d.x -= d.v * dt; }
+end_method
+
+template<class F>
+static void measure(const char* label, size_t count, int rounds, double& ns, F f) {
+    perf_counters counters;
+    counters.start();
+    const clock_t begin = clock();
+    for(int r = 0 ; r < rounds ; ++r) {
+        f();
+    }
+    const double seconds = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+
+    char text[64];
+    snprintf(text, sizeof(text), "%s, %zu objects", label, count);
+    counters.report(text, double(count) * rounds);
+    ns = seconds * 1e9 / (double(count) * rounds);
+}
+
+// Calls a unary multimethod for objects of random types: stored in a vector of pointers (one
+// dispatch per object) and in a poly_vector (one dispatch per segment of a type).
+//
+int main() {
+    printf("objects,pointers_ns,poly_vector_ns\n");
+
+    for(size_t count : { 10000, 1000000, 10000000 }) {
+        mt19937 rnd(1);
+        vector<unique_ptr<thing>> pointers;
+        multimethods::poly_vector<thing> objects;
+
+        for(size_t i = 0 ; i < count ; ++i) {
+            switch(rnd() % 4) {
+                case 0: pointers.push_back(make_unique<asteroid>()); objects.emplace_back<asteroid>(); break;
+                case 1: pointers.push_back(make_unique<spaceship>()); objects.emplace_back<spaceship>(); break;
+                case 2: pointers.push_back(make_unique<station>()); objects.emplace_back<station>(); break;
+                default: pointers.push_back(make_unique<debris>()); objects.emplace_back<debris>(); break;
+            }
+        }
+
+        const int rounds = int(20000000 / count) + 1;
+        double loop = 0, segments = 0;
+
+        measure("pointers", count, rounds, loop, [&] {
+            for(auto& p : pointers) {
+                update(*p, 0.5f);
+            }
+        });
+        measure("poly_vector", count, rounds, segments, [&] {
+            multimethods::for_each(MM_METHOD(update), objects, 0.5f);
+        });
+
+        double sum1 = 0, sum2 = 0;
+        for(auto& p : pointers) {
+            sum1 += p->x + p->v;
+        }
+        objects.for_each([&](thing& t) { sum2 += t.x + t.v; });
+
+        if(sum1 != sum2) {
+            printf("Results differ\n");
+            return 1;
+        }
+
+        printf("%zu,%.2f,%.2f\n", count, loop, segments);
+    }
+}
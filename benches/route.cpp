@@ -0,0 +1,128 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+// Messages of a wire protocol: the first byte is the tag, the rest is a payload
+struct message { uint8_t kind; };
+
+template<int N>
+struct msg final : message { MM_TYPE_ID(N) uint8_t data[255]; };
+
+inline uint8_t mm_type_id(const message& m) { return m.kind; }
+
+MM_SEALED(message, msg<1>, msg<2>, msg<3>, msg<4>, msg<5>, msg<6>, msg<7>, msg<8>)
+
+static constexpr int kinds = 8;
+static constexpr size_t packet_size = sizeof(msg<1>);
+
+// Half of kinds are handled, others are dropped
+int multi_method(handle, const message&)
+    match(const msg<1>& m) { return m.data[0] + 1; }
+    match(const msg<2>& m) { return m.data[1] + 2; }
+    match(const msg<3>& m) { return m.data[2] + 3; }
+    match(const msg<4>& m) { return m.data[3] + 4; }
+    fallback { return 0; }
+end_method
+
+template<class T>
+static T decode(const byte* packet) {
+    T r;
+    memcpy(static_cast<void*>(&r), packet, sizeof(T));
+    return r;
+}
+
+// Decodes every packet into an object of its class and calls the multimethod
+static int decode_and_call(const byte* packet) {
+    switch(static_cast<uint8_t>(packet[0])) {
+        case 1: return handle(decode<msg<1>>(packet));
+        case 2: return handle(decode<msg<2>>(packet));
+        case 3: return handle(decode<msg<3>>(packet));
+        case 4: return handle(decode<msg<4>>(packet));
+        case 5: return handle(decode<msg<5>>(packet));
+        case 6: return handle(decode<msg<6>>(packet));
+        case 7: return handle(decode<msg<7>>(packet));
+        case 8: return handle(decode<msg<8>>(packet));
+    }
+    return 0;
+}
+
+// Selects the implementation by the tag, decodes only handled packets
+template<class R>
+static int route_and_call(const R& r, const byte* packet) {
+    int result = 0;
+    if(r) {
+        r.template with_class<0>([&](auto* type) {
+            result = r(decode<remove_pointer_t<decltype(type)>>(packet));
+        });
+    }
+    return result;
+}
+
+template<class F>
+static double measure(const char* label, int calls, F f) {
+    perf_counters counters;
+    counters.start();
+    const clock_t begin = clock();
+    const long r = f();
+    const double seconds = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report(label, calls);
+    cerr << label << " checksum: " << r << '\n';
+    return seconds * 1e9 / calls;
+}
+
+// Handles packets of 8 kinds (4 of them are dropped), uniformly distributed: decoding each
+// packet and calling the multimethod, routing by the tag before decoding, and routing by
+// routes selected once for each tag:
+//
+//   route [calls]
+//
+int main(int argc, char** argv) {
+    const int calls = argc > 1 ? atoi(argv[1]) : 20000000;
+    mt19937 rnd(1);
+
+    vector<byte> packets(1024 * packet_size);
+    for(size_t i = 0 ; i < packets.size() ; ++i) {
+        packets[i] = static_cast<byte>(i % packet_size ? rnd() & 0xFF : rnd() % kinds + 1);
+    }
+    auto packet = [&](int i) { return packets.data() + size_t((i * 7) & 1023) * packet_size; };
+
+    vector<multimethods::tag_route<mm_method_handle>> routes;
+    for(int kind = 0 ; kind <= kinds ; ++kind) {
+        routes.push_back(multimethods::route(MM_METHOD(handle), kind));
+    }
+
+    const double decoded = measure("decode and call", calls, [&] {
+        long sum = 0;
+        for(int i = 0 ; i < calls ; ++i) {
+            sum += decode_and_call(packet(i));
+        }
+        return sum;
+    });
+    const double routed = measure("route and call", calls, [&] {
+        long sum = 0;
+        for(int i = 0 ; i < calls ; ++i) {
+            const byte* p = packet(i);
+            sum += route_and_call(multimethods::route(MM_METHOD(handle), static_cast<uint8_t>(p[0])), p);
+        }
+        return sum;
+    });
+    const double table = measure("table of routes", calls, [&] {
+        long sum = 0;
+        for(int i = 0 ; i < calls ; ++i) {
+            const byte* p = packet(i);
+            sum += route_and_call(routes[static_cast<uint8_t>(p[0])], p);
+        }
+        return sum;
+    });
+
+    printf("kinds,payload_bytes,decode_ns,route_ns,table_ns\n%d,%zu,%.2f,%.2f,%.2f\n",
+        kinds, packet_size, decoded, routed, table);
+}
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Builds and runs synthetic benchmarks (see generate.cmake) while one parameter grows,
+# other parameters are fixed. Prints CSV to stdout:
+#
+#   CXX=clang++ CALLS=10000000 benches/scaling.sh [dimension...]
+#
+# where dimension is classes, depth, methods, arity, impls or variants (all by default).
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+CXX=${CXX:-clang++}
+CALLS=${CALLS:-10000000}
+OUT=${OUT:-/tmp/multimethods-scaling}
+DIMENSIONS=${*:-classes depth methods arity impls variants}
+
+mkdir -p "$OUT"
+
+now() {
+    date +%s.%N
+}
+
+# run <dimension> <value> <cmake definitions...>
+run() {
+    dimension=$1
+    value=$2
+    shift 2
+
+    cmake -DOUTPUT="$OUT/synthetic.cpp" "$@" -P benches/generate.cmake > /dev/null
+
+    begin=$(now)
+    $CXX -std=c++17 -O2 -I. "$OUT/synthetic.cpp" -o "$OUT/synthetic" 2> "$OUT/compile.log"
+    end=$(now)
+
+    compile=$(echo "$begin $end" | awk '{ printf "%.2f", $2 - $1 }')
+    size=$(wc -c < "$OUT/synthetic")
+
+    echo "$dimension,$value,$compile,$size,$("$OUT/synthetic" "$CALLS")"
+}
+
+echo "dimension,value,compile_s,binary_bytes,init_us,first_call_ns,call_ns,rss_init_kb,rss_kb,cycles,instructions,branch_misses,l1d_misses,l1i_misses"
+
+for dimension in $DIMENSIONS; do
+    case $dimension in
+        classes)
+            for n in 16 64 256 1200; do
+                run classes $n -DCLASSES=$n -DWIDTH=4 -DDEPTH=10 -DMETHODS=10
+            done;;
+        depth)
+            for n in 2 4 6 8 10; do
+                run depth $n -DDEPTH=$n -DWIDTH=2 -DCLASSES=1200 -DMETHODS=10
+            done;;
+        methods)
+            for n in 1 10 30 100 300; do
+                run methods $n -DMETHODS=$n -DIMPLS=8
+            done;;
+        arity)
+            for n in 1 2 3 4 6; do
+                run arity $n -DARITY=$n -DMETHODS=10 -DIMPLS=8
+            done;;
+        impls)
+            for n in 1 4 16 32 64; do
+                run impls $n -DIMPLS=$n -DMETHODS=10
+            done;;
+        variants)
+            run variants plain -DMETHODS=10
+            run variants mm_class -DMETHODS=10 -DMM_CLASS=1
+            run variants multiple -DMETHODS=10 -DMULTIPLE=1
+            run variants virtual -DMETHODS=10 -DVIRTUAL=1
+            run variants virtual_multiple -DMETHODS=10 -DVIRTUAL=1 -DMULTIPLE=1;;
+        *)
+            echo "Unknown dimension: $dimension" >&2
+            exit 1;;
+    esac
+done
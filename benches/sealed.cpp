@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <multimethods.h>
+#include "perf_counters.h"
+using namespace std;
+
+struct asteroid;
+struct spaceship;
+
+// Hand-written double dispatch
+struct thing {
+    virtual ~thing() {}
+    virtual int collide(thing& o) = 0;
+    virtual int collide_with(asteroid& o) = 0;
+    virtual int collide_with(spaceship& o) = 0;
+};
+
+struct asteroid final : thing {
+    int collide(thing& o) final { return o.collide_with(*this); }
+    int collide_with(asteroid&) final { return 1; }
+    int collide_with(spaceship&) final { return 3; }
+};
+
+struct spaceship final : thing {
+    int collide(thing& o) final { return o.collide_with(*this); }
+    int collide_with(asteroid&) final { return 2; }
+    int collide_with(spaceship&) final { return 4; }
+};
+
+// The same classes, but without MM_SEALED
+struct body { virtual ~body() {} };
+struct rock final : body {};
+struct ship final : body {};
+
+// The same classes without vtables, dynamic types are found by tags
+struct item { std::uint8_t kind; };
+struct stone final : item { MM_TYPE_ID(1) };
+struct rocket final : item { MM_TYPE_ID(2) };
+
+inline std::uint8_t mm_type_id(const item& v) { return v.kind; }
+
+MM_SEALED(thing, asteroid, spaceship)
+MM_SEALED(item, stone, rocket)
+
+int multi_method(collide_sealed, thing&, thing&)
+    match(asteroid&, asteroid&) { return 1; }
+    match(asteroid&, spaceship&) { return 2; }
+    match(spaceship&, asteroid&) { return 3; }
+    match(spaceship&, spaceship&) { return 4; }
+end_method
+
+int multi_method(collide_tagged, item&, item&)
+    match(stone&, stone&) { return 1; }
+    match(stone&, rocket&) { return 2; }
+    match(rocket&, stone&) { return 3; }
+    match(rocket&, rocket&) { return 4; }
+end_method
+
+int multi_method(collide_open, body&, body&)
+    match(rock&, rock&) { return 1; }
+    match(rock&, ship&) { return 2; }
+    match(ship&, rock&) { return 3; }
+    match(ship&, ship&) { return 4; }
+end_method
+
+template<class T, class F>
+double measure(const char* label, T** objects, int calls, long& sum, F f) {
+    perf_counters counters;
+    counters.start();
+    const clock_t begin = clock();
+    for(int i = 0 ; i < calls ; ++i) {
+        sum += f(*objects[i & 3], *objects[(i >> 2) & 3]);
+    }
+    const double r = double(clock() - begin) / CLOCKS_PER_SEC;
+    counters.stop();
+    counters.report(label, calls);
+    return r * 1e9 / calls;
+}
+
+// Compares hand-written double dispatch, a multimethod with a sealed hierarchy (a nested switch
+// with inlined bodies), the same for classes with tags instead of vtables and a multimethod for
+// an open hierarchy.
+//
+int main() {
+    asteroid a1, a2;
+    spaceship s1, s2;
+    rock r1, r2;
+    ship h1, h2;
+    stone t1 {}, t2 {};
+    rocket k1 {}, k2 {};
+    t1.kind = t2.kind = 1;
+    k1.kind = k2.kind = 2;
+    thing* things[] = { &a1, &s1, &s2, &a2 };
+    body* bodies[] = { &r1, &h1, &h2, &r2 };
+    item* items[] = { &t1, &k1, &k2, &t2 };
+    const int calls = 200000000;
+    long sum1 = 0, sum2 = 0, sum3 = 0, sum4 = 0;
+
+    const double virt = measure("virtual", things, calls, sum1, [](thing& x, thing& y) { return x.collide(y); });
+    const double sealed = measure("sealed", things, calls, sum2, [](thing& x, thing& y) { return collide_sealed(x, y); });
+    const double tagged = measure("tagged", items, calls, sum4, [](item& x, item& y) { return collide_tagged(x, y); });
+    const double open = measure("open", bodies, calls, sum3, [](body& x, body& y) { return collide_open(x, y); });
+
+    if(sum1 != sum2 || sum1 != sum3 || sum1 != sum4) {
+        printf("Results differ\n");
+        return 1;
+    }
+
+    printf("virtual_ns,sealed_ns,tagged_ns,open_ns\n%.2f,%.2f,%.2f,%.2f\n", virt, sealed, tagged, open);
+}
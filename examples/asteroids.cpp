@@ -9,9 +9,8 @@ struct spaceship : thing {};
 
 void multi_method(collide, thing&, thing&)
     match(asteroid&, asteroid&) { cout << "Traverse\n"; }
-    match(asteroid&, bullet&) { cout << "Hit\n"; }
-    match(asteroid&, spaceship&) { cout << "Boom\n"; }
-    match(thing& t, asteroid& a) { collide(a, t); }
+    match_sym(asteroid&, bullet&) { cout << "Hit\n"; }
+    match_sym(asteroid&, spaceship&) { cout << "Boom\n"; }
     fallback {}
 end_method
 
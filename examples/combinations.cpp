@@ -0,0 +1,32 @@
+#include <iostream>
+#include <multimethods.h>
+using namespace std;
+
+struct vehicle { virtual ~vehicle() {} };
+struct car : vehicle {};
+struct truck : vehicle {};
+struct inspector { virtual ~inspector() {} };
+struct state_inspector : inspector {};
+
+int multi_method(inspect, const vehicle&, const inspector&)
+    match(const vehicle&, const inspector&) { cout << "Inspect vehicle.\n"; return 1; }
+    match(const car&, const inspector&) { cout << "Inspect seat belts.\n"; return 2; }
+    match_before(const vehicle&, const inspector&) { cout << "Open the hood.\n"; }
+    match_before(const car&, const state_inspector&) { cout << "Check insurance.\n"; }
+    match_after(const vehicle&, const inspector&) { cout << "Close the hood.\n"; }
+    match_after(const truck&, const inspector&) { cout << "Weigh the truck.\n"; }
+    match_around(const vehicle&, const state_inspector&) {
+        cout << "Start the report.\n";
+        const int r = call_next_method;
+        cout << "Sign the report.\n";
+        return r * 10;
+    }
+end_method
+
+int main() {
+    // Start the report. Check insurance. Open the hood. Inspect seat belts. Close the hood. Sign the report.
+    cout << inspect(car(), state_inspector()) << '\n'; // 20
+
+    // Open the hood. Inspect vehicle. Close the hood. Weigh the truck.
+    cout << inspect(truck(), inspector()) << '\n'; // 1
+}
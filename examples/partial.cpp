@@ -0,0 +1,42 @@
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <multimethods.h>
+using namespace std;
+
+struct device { virtual ~device() {} };
+struct screen : device {};
+struct printer : device {};
+
+struct shape { virtual ~shape() {} };
+struct circle : shape {};
+struct rect : shape {};
+struct square : rect {};
+
+const char* multi_method(draw, device&, const shape&)
+    match(screen&, const circle&) { return "screen circle"; }
+    match(screen&, const rect&) { return "screen rect"; }
+    match(printer&, const shape&) { return "printer shape"; }
+    match(device&, const square&) { next_method; }
+    fallback { return "nothing"; }
+end_method
+
+int main() {
+    vector<unique_ptr<shape>> shapes;
+    shapes.push_back(make_unique<circle>());
+    shapes.push_back(make_unique<rect>());
+    shapes.push_back(make_unique<square>());
+
+    screen s;
+    printer p;
+    device d;
+
+    // Types of devices are found once, shapes are dispatched on each call
+    for(device* dev : { static_cast<device*>(&s), static_cast<device*>(&p), &d }) {
+        auto paint = multimethods::partial(MM_METHOD(draw), *dev);
+        for(auto& sh : shapes) {
+            cout << paint(*sh) << ", "; // 'screen circle, screen rect, screen rect, printer shape, ...'
+        }
+        cout << (paint ? "" : "(no implementations)") << '\n';
+    }
+}
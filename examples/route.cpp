@@ -0,0 +1,64 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <multimethods.h>
+using namespace std;
+
+// Messages of a wire protocol, the header tells the type before the payload is decoded
+struct message { uint8_t kind; };
+struct login : message { MM_TYPE_ID(1) char user[8]; };
+struct chat : message { MM_TYPE_ID(2) uint32_t room; char text[16]; };
+struct ping : message { MM_TYPE_ID(3) };
+
+inline uint8_t mm_type_id(const message& m) { return m.kind; }
+
+MM_SEALED(message, login, chat, ping)
+
+void multi_method(handle, const message&, int)
+    match(const login& m, int peer) { cout << peer << ": login " << m.user << '\n'; }
+    match(const chat& m, int peer) { cout << peer << ": chat " << m.room << ' ' << m.text << '\n'; }
+end_method
+
+// Builds an object of the class straight from the payload
+template<class T>
+T decode(const byte* payload, size_t size) {
+    T r {};
+    memcpy(static_cast<void*>(&r), payload, min(size, sizeof(T)));
+    return r;
+}
+
+template<class T>
+vector<byte> encode(const T& m) {
+    vector<byte> r(sizeof(T));
+    memcpy(r.data(), static_cast<const void*>(&m), sizeof(T));
+    return r;
+}
+
+int main() {
+    login l {};
+    l.kind = 1;
+    strcpy(l.user, "alice");
+    chat c {};
+    c.kind = 2;
+    c.room = 7;
+    strcpy(c.text, "hello");
+    ping p {};
+    p.kind = 3;
+
+    for(const vector<byte>& packet : { encode(l), encode(c), encode(p) }) {
+        const auto kind = static_cast<uint8_t>(packet[0]);
+
+        auto r = multimethods::route(MM_METHOD(handle), kind);
+        if(!r) {
+            cout << "dropped " << int(kind) << '\n'; // 'ping' isn't handled, so it's never decoded
+            continue;
+        }
+
+        r.with_class<0>([&](auto* type) {
+            const auto m = decode<remove_pointer_t<decltype(type)>>(packet.data(), packet.size());
+            r(m, 42); // Calls the selected implementation without dispatching
+        });
+    }
+}
@@ -0,0 +1,52 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <multimethods.h>
+using namespace std;
+
+// Plain structs without vtables, the dynamic type is stored in a tag
+struct shape { uint8_t kind; float x, y; };
+struct circle : shape { MM_TYPE_ID(1) float r; };
+struct rect : shape { MM_TYPE_ID(2) float w, h; };
+struct square : rect { MM_TYPE_ID(3) };
+
+inline uint8_t mm_type_id(const shape& s) { return s.kind; }
+
+MM_SEALED(shape, circle, rect, square)
+
+const char* multi_method(intersect, const shape&, const shape&)
+    match(const circle&, const circle&) { return "circle-circle"; }
+    match_sym(const circle&, const rect&) { return "circle-rect"; }
+    match(const rect&, const rect&) { return "rect-rect"; }
+    match(const square&, const square&) { next_method; }
+    fallback { return "unknown"; }
+end_method
+
+void multi_method(scale, shape&, float)
+    match(circle& c, float f) { c.r *= f; }
+    match(rect& r, float f) { r.w *= f; r.h *= f; }
+end_method
+
+int main() {
+    circle c {};
+    c.kind = 1;
+    rect r {};
+    r.kind = 2;
+    square s {};
+    s.kind = 3;
+    shape u { 7, 0, 0 };
+
+    vector<shape*> shapes = { &c, &r, &s, &u };
+    for(shape* a : shapes) {
+        for(shape* b : shapes) {
+            cout << intersect(*a, *b) << ' '; // 'rect-rect' for squares, 'unknown' for the last one
+        }
+        cout << '\n';
+    }
+
+    c.r = 1;
+    s.w = s.h = 2;
+    scale(c, 2);
+    scale(s, 3);
+    cout << c.r << ' ' << s.w << '\n'; // '2 6'
+}
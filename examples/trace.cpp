@@ -0,0 +1,31 @@
+#define MM_ENABLE_TRACE
+#include <iostream>
+#include <multimethods.h>
+using namespace std;
+
+struct thing { virtual ~thing() {} };
+struct asteroid : thing {};
+struct spaceship : thing {};
+
+void multi_method(collide, thing&, thing&)
+    match(asteroid&, spaceship&) { cout << "Boom\n"; }
+    match(thing&, thing&) { cout << "Traverse\n"; }
+    fallback {}
+end_method
+
+int main() {
+    asteroid a;
+    spaceship s;
+
+    collide(a, s); // Boom
+    collide(s, a); // Traverse
+
+    vector<multimethods::trace_record> records;
+    multimethods::drain_trace(records);
+
+    for(auto& r : records) {
+        cout << multimethods::method_name(r.method_) << ": impl " << int(r.impl_) << ", probes " << int(r.probes_) << endl;
+    }
+
+    multimethods::dump_trace("trace.bin");
+}
@@ -12,10 +12,68 @@
 #define H_IN_MULTIMETHODS
 
 #include <algorithm>
+#include <any>
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <tuple>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(MM_ENABLE_TRACE) || defined(MM_ENABLE_PROFILE)
+    #include <chrono>
+    #include <initializer_list>
+    #if defined(__x86_64__) || defined(__i386__)
+        #include <x86intrin.h>
+    #elif defined(_M_X64) || defined(_M_IX86)
+        #include <intrin.h>
+    #endif
+    #if __has_include(<cxxabi.h>)
+        #include <cxxabi.h>
+        #include <cstdlib>
+    #endif
+#endif
+
+/**********************************************************************************************/
+// Memory for dispatch caches of all multimethods, in bytes. Can be changed at runtime with
+// 'multimethods::set_cache_budget'.
+//
+#ifndef MM_CACHE_BUDGET
+    #define MM_CACHE_BUDGET (std::size_t(64) << 20)
+#endif
+
+/**********************************************************************************************/
+// Limit of the nested switch for sealed hierarchies: product of counts of classes of all
+// dispatched parameters. Each tuple of classes is a leaf, that checks all implementations at
+// compile time, so methods with more tuples use the dispatch cache instead.
+//
+#ifndef MM_SEALED_MAX_TUPLES
+    #define MM_SEALED_MAX_TUPLES 256
+#endif
+
+/**********************************************************************************************/
+// Code shared by implementations and dispatchers of all multimethods is kept out of line, so
+// each of them doesn't carry its own copy (MM_COLD - for paths that are rarely taken).
+//
+#if defined(__GNUC__)
+    #define MM_NOINLINE __attribute__((noinline))
+    #define MM_COLD __attribute__((noinline, cold))
+#elif defined(_MSC_VER)
+    #define MM_NOINLINE __declspec(noinline)
+    #define MM_COLD __declspec(noinline)
+#else
+    #define MM_NOINLINE
+    #define MM_COLD
+#endif
 
 /**********************************************************************************************/
 // Defines a new multimethod and specifies it's result type and parameters.
@@ -47,191 +105,362 @@
         static inline method_t* g_fallback { nullptr }; \
         static inline method_t* g_impls[MM_MAX_IMPLEMENTATIONS]; \
         static inline method_t** g_impls_end { g_impls }; \
-    }; \
-    \
-    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 0>> \
-    inline mm_namespace_ ## name::ret_type_t name() { \
-        using namespace ::multimethods::detail; \
-        using namespace mm_namespace_ ## name; \
+        static inline method_info g_info { #name, arity }; \
         \
-        for(auto m = g_impls ; m != g_impls_end ; ++m) \
-            try { \
-                if(auto r = (*m)->call()) { \
-                    return method_result<ret_type_t>::unwrap(r); \
-                } \
-            } catch(try_next&) { \
-            } \
+        using cache_t = dispatch_cache<arity>; \
+        static inline cache_t g_cache { g_info }; \
         \
-        if(g_fallback) { \
-            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
-                return method_result<ret_type_t>::unwrap(r); \
-            } \
-        } \
+        static inline arg_descs<method_t> g_descs[6] { \
+            { g_impls, &g_impls_end, 0 }, { g_impls, &g_impls_end, 1 }, { g_impls, &g_impls_end, 2 }, \
+            { g_impls, &g_impls_end, 3 }, { g_impls, &g_impls_end, 4 }, { g_impls, &g_impls_end, 5 } }; \
         \
-        throw ::multimethods::not_implemented(#name ": not implemented."); \
-    } \
-    \
-    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 1>> \
-    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1) { \
-        using namespace ::multimethods::detail; \
-        using namespace mm_namespace_ ## name; \
+        static inline const method_data<method_t> g_data { g_impls, g_impls_end, g_fallback, g_descs, g_info, #name }; \
         \
-        const arg<base1_t> a1(p1); \
+        template<int N> \
+        struct dispatched; /* Positions of parameters that are specialized by implementations. */ \
         \
-        for(auto m = g_impls ; m != g_impls_end ; ++m) \
-            try { \
-                if(auto r = (*m)->call(a1)) { \
-                    return method_result<ret_type_t>::unwrap(r); \
-                } \
-            } catch(try_next&) { \
-            } \
+        template<int N> \
+        struct sealed; /* Dispatcher for sealed hierarchies. */ \
         \
-        if(g_fallback) { \
-            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
-                return method_result<ret_type_t>::unwrap(r); \
-            } \
-        } \
+        template<int N> \
+        struct qualifiers; /* Before, after and around implementations. */ \
         \
-        throw ::multimethods::not_implemented(#name ": not implemented."); \
-    } \
+        template<int N> \
+        using impl_t = typename dependent_type<N, method_t>::type; /* Calls are checked only for the method's arity. */ \
+    }; \
     \
-    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 2>> \
-    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2) { \
-        using namespace ::multimethods::detail; \
-        using namespace mm_namespace_ ## name; \
-        \
-        const arg<base1_t> a1(p1); \
-        const arg<base2_t> a2(p2); \
+    struct mm_method_ ## name final { \
+        using proto_traits_t = mm_namespace_ ## name::proto_traits_t; \
+        using method_t       = mm_namespace_ ## name::method_t; \
         \
-        for(auto m = g_impls ; m != g_impls_end ; ++m) \
-            try { \
-                if(auto r = (*m)->call(a1, a2)) { \
-                    return method_result<ret_type_t>::unwrap(r); \
-                } \
-            } catch(try_next&) { \
-            } \
+        static const ::multimethods::detail::method_data<method_t>& data() { return mm_namespace_ ## name::g_data; } \
         \
-        if(g_fallback) { \
-            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
-                return method_result<ret_type_t>::unwrap(r); \
-            } \
-        } \
+        /* True if the method has before, after or around implementations */ \
+        template<int N = mm_namespace_ ## name::arity> \
+        static constexpr bool qualified() { return mm_namespace_ ## name::qualifiers<N>::enabled; } \
         \
-        throw ::multimethods::not_implemented(#name ": not implemented."); \
-    } \
-    \
-    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 3>> \
-    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3) { \
-        using namespace ::multimethods::detail; \
-        using namespace mm_namespace_ ## name; \
+        /* Dispatcher for sealed hierarchies and positions of dispatched parameters */ \
+        template<int N = mm_namespace_ ## name::arity> \
+        using sealed_t = mm_namespace_ ## name::sealed<N>; \
         \
-        const arg<base1_t> a1(p1); \
-        const arg<base2_t> a2(p2); \
-        const arg<base3_t> a3(p3); \
+        template<int N = mm_namespace_ ## name::arity> \
+        static constexpr unsigned dispatched_mask() { return mm_namespace_ ## name::dispatched<N>::mask; } \
         \
-        for(auto m = g_impls ; m != g_impls_end ; ++m) \
-            try { \
-                if(auto r = (*m)->call(a1, a2, a3)) { \
-                    return method_result<ret_type_t>::unwrap(r); \
+        template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 0>> \
+        mm_namespace_ ## name::ret_type_t operator()() const { \
+            using namespace ::multimethods::detail; \
+            using namespace mm_namespace_ ## name; \
+            \
+            MM_TRACE_BEGIN() \
+            MM_PROFILE_BEGIN \
+            \
+            for(impl_t<N>** m = g_impls ; m != g_impls_end ; ++m) \
+                try { \
+                    MM_TRACE_PROBE \
+                    if(auto r = (*m)->call()) { \
+                        MM_TRACE_SELECT \
+                        MM_PROFILE_END((*m)->index_) \
+                        return method_result<ret_type_t>::unwrap(r); \
+                    } \
+                } catch(try_next&) { \
+                    MM_TRACE_NEXT \
+                    MM_PROFILE_NEXT \
                 } \
-            } catch(try_next&) { \
-            } \
+            \
+            MM_CALL_FALLBACK(#name) \
+        } \
         \
-        if(g_fallback) { \
-            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
-                return method_result<ret_type_t>::unwrap(r); \
+        template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 1>> \
+        mm_namespace_ ## name::ret_type_t operator()(mm_namespace_ ## name::base1_t p1) const { \
+            using namespace ::multimethods::detail; \
+            using namespace mm_namespace_ ## name; \
+            \
+            constexpr unsigned mask = dispatched<N>::mask; \
+            MM_SEALED_DISPATCH(#name, p1) \
+            MM_QUALIFIED_DISPATCH(p1) \
+            const arg<base1_t> a1(p1, mask & 1); \
+            const cache_t::key_t key { { mask & 1 ? a1.type() : nullptr } }; \
+            \
+            MM_TRACE_BEGIN(a1.type()) \
+            MM_PROFILE_BEGIN \
+            \
+            int start = g_cache.find(key); \
+            if(start < 0) { \
+                start = g_cache.insert(key, a1.resolve(g_descs[0]) & chain_between(0, static_cast<int>(g_impls_end - g_impls))); \
             } \
+            \
+            for(impl_t<N>** m = g_impls + start ; m < g_impls_end ; ++m) \
+                try { \
+                    MM_TRACE_PROBE \
+                    if(auto r = (*m)->call(a1)) { \
+                        MM_TRACE_SELECT \
+                        MM_PROFILE_END((*m)->index_) \
+                        return method_result<ret_type_t>::unwrap(r); \
+                    } \
+                } catch(try_next&) { \
+                    /* Jumps to the next applicable implementation from the cached chain */ \
+                    const std::uint64_t rest = g_cache.next(key, static_cast<int>(m - g_impls)); \
+                    m = g_impls + (rest ? lowest_bit(rest) : MM_MAX_IMPLEMENTATIONS) - 1; \
+                    MM_TRACE_NEXT \
+                    MM_PROFILE_NEXT \
+                } \
+            \
+            MM_CALL_FALLBACK(#name) \
         } \
         \
-        throw ::multimethods::not_implemented(#name ": not implemented."); \
-    } \
-    \
-    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 4>> \
-    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4) { \
-        using namespace ::multimethods::detail; \
-        using namespace mm_namespace_ ## name; \
-        \
-        const arg<base1_t> a1(p1); \
-        const arg<base2_t> a2(p2); \
-        const arg<base3_t> a3(p3); \
-        const arg<base4_t> a4(p4); \
-        \
-        for(auto m = g_impls ; m != g_impls_end ; ++m) \
-            try { \
-                if(auto r = (*m)->call(a1, a2, a3, a4)) { \
-                    return method_result<ret_type_t>::unwrap(r); \
-                } \
-            } catch(try_next&) { \
+        template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 2>> \
+        mm_namespace_ ## name::ret_type_t operator()(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2) const { \
+            using namespace ::multimethods::detail; \
+            using namespace mm_namespace_ ## name; \
+            \
+            constexpr unsigned mask = dispatched<N>::mask; \
+            MM_SEALED_DISPATCH(#name, p1, p2) \
+            MM_QUALIFIED_DISPATCH(p1, p2) \
+            const arg<base1_t> a1(p1, mask & 1); \
+            const arg<base2_t> a2(p2, mask & 2); \
+            const cache_t::key_t key { { mask & 1 ? a1.type() : nullptr, mask & 2 ? a2.type() : nullptr } }; \
+            \
+            MM_TRACE_BEGIN(a1.type(), a2.type()) \
+            MM_PROFILE_BEGIN \
+            \
+            int start = g_cache.find(key); \
+            if(start < 0) { \
+                start = g_cache.insert(key, a1.resolve(g_descs[0]) & a2.resolve(g_descs[1]) & chain_between(0, static_cast<int>(g_impls_end - g_impls))); \
             } \
+            \
+            for(impl_t<N>** m = g_impls + start ; m < g_impls_end ; ++m) \
+                try { \
+                    MM_TRACE_PROBE \
+                    if(auto r = (*m)->call(a1, a2)) { \
+                        MM_TRACE_SELECT \
+                        MM_PROFILE_END((*m)->index_) \
+                        return method_result<ret_type_t>::unwrap(r); \
+                    } \
+                } catch(try_next&) { \
+                    /* Jumps to the next applicable implementation from the cached chain */ \
+                    const std::uint64_t rest = g_cache.next(key, static_cast<int>(m - g_impls)); \
+                    m = g_impls + (rest ? lowest_bit(rest) : MM_MAX_IMPLEMENTATIONS) - 1; \
+                    MM_TRACE_NEXT \
+                    MM_PROFILE_NEXT \
+                } \
+            \
+            MM_CALL_FALLBACK(#name) \
+        } \
         \
-        if(g_fallback) { \
-            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
-                return method_result<ret_type_t>::unwrap(r); \
+        template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 3>> \
+        mm_namespace_ ## name::ret_type_t operator()(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3) const { \
+            using namespace ::multimethods::detail; \
+            using namespace mm_namespace_ ## name; \
+            \
+            constexpr unsigned mask = dispatched<N>::mask; \
+            MM_SEALED_DISPATCH(#name, p1, p2, p3) \
+            MM_QUALIFIED_DISPATCH(p1, p2, p3) \
+            const arg<base1_t> a1(p1, mask & 1); \
+            const arg<base2_t> a2(p2, mask & 2); \
+            const arg<base3_t> a3(p3, mask & 4); \
+            const cache_t::key_t key { { mask & 1 ? a1.type() : nullptr, mask & 2 ? a2.type() : nullptr, mask & 4 ? a3.type() : nullptr } }; \
+            \
+            MM_TRACE_BEGIN(a1.type(), a2.type(), a3.type()) \
+            MM_PROFILE_BEGIN \
+            \
+            int start = g_cache.find(key); \
+            if(start < 0) { \
+                start = g_cache.insert(key, a1.resolve(g_descs[0]) & a2.resolve(g_descs[1]) & a3.resolve(g_descs[2]) & chain_between(0, static_cast<int>(g_impls_end - g_impls))); \
             } \
+            \
+            for(impl_t<N>** m = g_impls + start ; m < g_impls_end ; ++m) \
+                try { \
+                    MM_TRACE_PROBE \
+                    if(auto r = (*m)->call(a1, a2, a3)) { \
+                        MM_TRACE_SELECT \
+                        MM_PROFILE_END((*m)->index_) \
+                        return method_result<ret_type_t>::unwrap(r); \
+                    } \
+                } catch(try_next&) { \
+                    /* Jumps to the next applicable implementation from the cached chain */ \
+                    const std::uint64_t rest = g_cache.next(key, static_cast<int>(m - g_impls)); \
+                    m = g_impls + (rest ? lowest_bit(rest) : MM_MAX_IMPLEMENTATIONS) - 1; \
+                    MM_TRACE_NEXT \
+                    MM_PROFILE_NEXT \
+                } \
+            \
+            MM_CALL_FALLBACK(#name) \
         } \
         \
-        throw ::multimethods::not_implemented(#name ": not implemented."); \
-    } \
-    \
-    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 5>> \
-    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4, mm_namespace_ ## name::base5_t p5) { \
-        using namespace ::multimethods::detail; \
-        using namespace mm_namespace_ ## name; \
-        \
-        const arg<base1_t> a1(p1); \
-        const arg<base2_t> a2(p2); \
-        const arg<base3_t> a3(p3); \
-        const arg<base4_t> a4(p4); \
-        const arg<base5_t> a5(p5); \
-        \
-        for(auto m = g_impls ; m != g_impls_end ; ++m) \
-            try { \
-                if(auto r = (*m)->call(a1, a2, a3, a4, a5)) { \
-                    return method_result<ret_type_t>::unwrap(r); \
-                } \
-            } catch(try_next&) { \
+        template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 4>> \
+        mm_namespace_ ## name::ret_type_t operator()(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4) const { \
+            using namespace ::multimethods::detail; \
+            using namespace mm_namespace_ ## name; \
+            \
+            constexpr unsigned mask = dispatched<N>::mask; \
+            MM_SEALED_DISPATCH(#name, p1, p2, p3, p4) \
+            MM_QUALIFIED_DISPATCH(p1, p2, p3, p4) \
+            const arg<base1_t> a1(p1, mask & 1); \
+            const arg<base2_t> a2(p2, mask & 2); \
+            const arg<base3_t> a3(p3, mask & 4); \
+            const arg<base4_t> a4(p4, mask & 8); \
+            const cache_t::key_t key { { mask & 1 ? a1.type() : nullptr, mask & 2 ? a2.type() : nullptr, mask & 4 ? a3.type() : nullptr, mask & 8 ? a4.type() : nullptr } }; \
+            \
+            MM_TRACE_BEGIN(a1.type(), a2.type(), a3.type(), a4.type()) \
+            MM_PROFILE_BEGIN \
+            \
+            int start = g_cache.find(key); \
+            if(start < 0) { \
+                start = g_cache.insert(key, a1.resolve(g_descs[0]) & a2.resolve(g_descs[1]) & a3.resolve(g_descs[2]) & a4.resolve(g_descs[3]) & chain_between(0, static_cast<int>(g_impls_end - g_impls))); \
             } \
+            \
+            for(impl_t<N>** m = g_impls + start ; m < g_impls_end ; ++m) \
+                try { \
+                    MM_TRACE_PROBE \
+                    if(auto r = (*m)->call(a1, a2, a3, a4)) { \
+                        MM_TRACE_SELECT \
+                        MM_PROFILE_END((*m)->index_) \
+                        return method_result<ret_type_t>::unwrap(r); \
+                    } \
+                } catch(try_next&) { \
+                    /* Jumps to the next applicable implementation from the cached chain */ \
+                    const std::uint64_t rest = g_cache.next(key, static_cast<int>(m - g_impls)); \
+                    m = g_impls + (rest ? lowest_bit(rest) : MM_MAX_IMPLEMENTATIONS) - 1; \
+                    MM_TRACE_NEXT \
+                    MM_PROFILE_NEXT \
+                } \
+            \
+            MM_CALL_FALLBACK(#name) \
+        } \
         \
-        if(g_fallback) { \
-            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
-                return method_result<ret_type_t>::unwrap(r); \
+        template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 5>> \
+        mm_namespace_ ## name::ret_type_t operator()(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4, mm_namespace_ ## name::base5_t p5) const { \
+            using namespace ::multimethods::detail; \
+            using namespace mm_namespace_ ## name; \
+            \
+            constexpr unsigned mask = dispatched<N>::mask; \
+            MM_SEALED_DISPATCH(#name, p1, p2, p3, p4, p5) \
+            MM_QUALIFIED_DISPATCH(p1, p2, p3, p4, p5) \
+            const arg<base1_t> a1(p1, mask & 1); \
+            const arg<base2_t> a2(p2, mask & 2); \
+            const arg<base3_t> a3(p3, mask & 4); \
+            const arg<base4_t> a4(p4, mask & 8); \
+            const arg<base5_t> a5(p5, mask & 16); \
+            const cache_t::key_t key { { mask & 1 ? a1.type() : nullptr, mask & 2 ? a2.type() : nullptr, mask & 4 ? a3.type() : nullptr, mask & 8 ? a4.type() : nullptr, mask & 16 ? a5.type() : nullptr } }; \
+            \
+            MM_TRACE_BEGIN(a1.type(), a2.type(), a3.type(), a4.type(), a5.type()) \
+            MM_PROFILE_BEGIN \
+            \
+            int start = g_cache.find(key); \
+            if(start < 0) { \
+                start = g_cache.insert(key, a1.resolve(g_descs[0]) & a2.resolve(g_descs[1]) & a3.resolve(g_descs[2]) & a4.resolve(g_descs[3]) & a5.resolve(g_descs[4]) & chain_between(0, static_cast<int>(g_impls_end - g_impls))); \
             } \
+            \
+            for(impl_t<N>** m = g_impls + start ; m < g_impls_end ; ++m) \
+                try { \
+                    MM_TRACE_PROBE \
+                    if(auto r = (*m)->call(a1, a2, a3, a4, a5)) { \
+                        MM_TRACE_SELECT \
+                        MM_PROFILE_END((*m)->index_) \
+                        return method_result<ret_type_t>::unwrap(r); \
+                    } \
+                } catch(try_next&) { \
+                    /* Jumps to the next applicable implementation from the cached chain */ \
+                    const std::uint64_t rest = g_cache.next(key, static_cast<int>(m - g_impls)); \
+                    m = g_impls + (rest ? lowest_bit(rest) : MM_MAX_IMPLEMENTATIONS) - 1; \
+                    MM_TRACE_NEXT \
+                    MM_PROFILE_NEXT \
+                } \
+            \
+            MM_CALL_FALLBACK(#name) \
         } \
         \
-        throw ::multimethods::not_implemented(#name ": not implemented."); \
-    } \
-    \
-    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 6>> \
-    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4, mm_namespace_ ## name::base5_t p5, mm_namespace_ ## name::base6_t p6) { \
-        using namespace ::multimethods::detail; \
-        using namespace mm_namespace_ ## name; \
-        \
-        const arg<base1_t> a1(p1); \
-        const arg<base2_t> a2(p2); \
-        const arg<base3_t> a3(p3); \
-        const arg<base4_t> a4(p4); \
-        const arg<base5_t> a5(p5); \
-        const arg<base6_t> a6(p6); \
-        \
-        for(auto m = g_impls ; m != g_impls_end ; ++m) \
-            try { \
-                if(auto r = (*m)->call(a1, a2, a3, a4, a5, a6)) { \
-                    return method_result<ret_type_t>::unwrap(r); \
-                } \
-            } catch(try_next&) { \
+        template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 6>> \
+        mm_namespace_ ## name::ret_type_t operator()(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4, mm_namespace_ ## name::base5_t p5, mm_namespace_ ## name::base6_t p6) const { \
+            using namespace ::multimethods::detail; \
+            using namespace mm_namespace_ ## name; \
+            \
+            constexpr unsigned mask = dispatched<N>::mask; \
+            MM_SEALED_DISPATCH(#name, p1, p2, p3, p4, p5, p6) \
+            MM_QUALIFIED_DISPATCH(p1, p2, p3, p4, p5, p6) \
+            const arg<base1_t> a1(p1, mask & 1); \
+            const arg<base2_t> a2(p2, mask & 2); \
+            const arg<base3_t> a3(p3, mask & 4); \
+            const arg<base4_t> a4(p4, mask & 8); \
+            const arg<base5_t> a5(p5, mask & 16); \
+            const arg<base6_t> a6(p6, mask & 32); \
+            const cache_t::key_t key { { mask & 1 ? a1.type() : nullptr, mask & 2 ? a2.type() : nullptr, mask & 4 ? a3.type() : nullptr, mask & 8 ? a4.type() : nullptr, mask & 16 ? a5.type() : nullptr, mask & 32 ? a6.type() : nullptr } }; \
+            \
+            MM_TRACE_BEGIN(a1.type(), a2.type(), a3.type(), a4.type(), a5.type(), a6.type()) \
+            MM_PROFILE_BEGIN \
+            \
+            int start = g_cache.find(key); \
+            if(start < 0) { \
+                start = g_cache.insert(key, a1.resolve(g_descs[0]) & a2.resolve(g_descs[1]) & a3.resolve(g_descs[2]) & a4.resolve(g_descs[3]) & a5.resolve(g_descs[4]) & a6.resolve(g_descs[5]) & chain_between(0, static_cast<int>(g_impls_end - g_impls))); \
             } \
+            \
+            for(impl_t<N>** m = g_impls + start ; m < g_impls_end ; ++m) \
+                try { \
+                    MM_TRACE_PROBE \
+                    if(auto r = (*m)->call(a1, a2, a3, a4, a5, a6)) { \
+                        MM_TRACE_SELECT \
+                        MM_PROFILE_END((*m)->index_) \
+                        return method_result<ret_type_t>::unwrap(r); \
+                    } \
+                } catch(try_next&) { \
+                    /* Jumps to the next applicable implementation from the cached chain */ \
+                    const std::uint64_t rest = g_cache.next(key, static_cast<int>(m - g_impls)); \
+                    m = g_impls + (rest ? lowest_bit(rest) : MM_MAX_IMPLEMENTATIONS) - 1; \
+                    MM_TRACE_NEXT \
+                    MM_PROFILE_NEXT \
+                } \
+            \
+            MM_CALL_FALLBACK(#name) \
+        } \
         \
-        if(g_fallback) { \
-            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
-                return method_result<ret_type_t>::unwrap(r); \
+        /* Call with arguments of a dispatch context, their dynamic types are already known */ \
+        template<class... A, int N = mm_namespace_ ## name::arity> \
+        mm_namespace_ ## name::ret_type_t operator()(const ::multimethods::dispatch_context<A...>& ctx) const { \
+            using namespace mm_namespace_ ## name; \
+            \
+            if constexpr(sealed<N>::enabled || qualifiers<N>::enabled) { \
+                return ctx.apply(*this); \
+            } else { \
+                return ::multimethods::detail::context_call<mm_method_ ## name>(ctx, std::index_sequence_for<A...>()); \
             } \
         } \
-        \
-        throw ::multimethods::not_implemented(#name ": not implemented."); \
-    } \
+    }; \
+    \
+    /* Functions, so the name may be overloaded; algorithms take the method as MM_METHOD(name) */ \
+    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 0>> \
+    inline mm_namespace_ ## name::ret_type_t name() { return typename ::multimethods::detail::dependent_type<N, mm_method_ ## name>::type {}(); } \
+    \
+    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 1>> \
+    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1) { return typename ::multimethods::detail::dependent_type<N, mm_method_ ## name>::type {}(std::forward<mm_namespace_ ## name::base1_t>(p1)); } \
+    \
+    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 2>> \
+    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2) { return typename ::multimethods::detail::dependent_type<N, mm_method_ ## name>::type {}(std::forward<mm_namespace_ ## name::base1_t>(p1), std::forward<mm_namespace_ ## name::base2_t>(p2)); } \
+    \
+    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 3>> \
+    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3) { return typename ::multimethods::detail::dependent_type<N, mm_method_ ## name>::type {}(std::forward<mm_namespace_ ## name::base1_t>(p1), std::forward<mm_namespace_ ## name::base2_t>(p2), std::forward<mm_namespace_ ## name::base3_t>(p3)); } \
+    \
+    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 4>> \
+    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4) { return typename ::multimethods::detail::dependent_type<N, mm_method_ ## name>::type {}(std::forward<mm_namespace_ ## name::base1_t>(p1), std::forward<mm_namespace_ ## name::base2_t>(p2), std::forward<mm_namespace_ ## name::base3_t>(p3), std::forward<mm_namespace_ ## name::base4_t>(p4)); } \
+    \
+    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 5>> \
+    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4, mm_namespace_ ## name::base5_t p5) { return typename ::multimethods::detail::dependent_type<N, mm_method_ ## name>::type {}(std::forward<mm_namespace_ ## name::base1_t>(p1), std::forward<mm_namespace_ ## name::base2_t>(p2), std::forward<mm_namespace_ ## name::base3_t>(p3), std::forward<mm_namespace_ ## name::base4_t>(p4), std::forward<mm_namespace_ ## name::base5_t>(p5)); } \
+    \
+    template<int N = mm_namespace_ ## name::arity, class = std::enable_if_t<N == 6>> \
+    inline mm_namespace_ ## name::ret_type_t name(mm_namespace_ ## name::base1_t p1, mm_namespace_ ## name::base2_t p2, mm_namespace_ ## name::base3_t p3, mm_namespace_ ## name::base4_t p4, mm_namespace_ ## name::base5_t p5, mm_namespace_ ## name::base6_t p6) { return typename ::multimethods::detail::dependent_type<N, mm_method_ ## name>::type {}(std::forward<mm_namespace_ ## name::base1_t>(p1), std::forward<mm_namespace_ ## name::base2_t>(p2), std::forward<mm_namespace_ ## name::base3_t>(p3), std::forward<mm_namespace_ ## name::base4_t>(p4), std::forward<mm_namespace_ ## name::base5_t>(p5), std::forward<mm_namespace_ ## name::base6_t>(p6)); } \
+    \
+    template<class... A> \
+    inline mm_namespace_ ## name::ret_type_t name(const ::multimethods::dispatch_context<A...>& ctx) { return mm_method_ ## name {}(ctx); } \
     \
     namespace mm_namespace_ ## name { \
-        const bool g_init = [] { constexpr ::multimethods::detail::method_impls sorter(std::tuple { true
+        static constexpr method_impls g_sorter { expand_symmetric(std::tuple { true
+
+/**********************************************************************************************/
+// A multimethod as an object, for algorithms that take methods (see 'resolve', 'partial',
+// 'for_each_pair'):
+//
+//   multimethods::for_each_pair(MM_METHOD(collide), asteroids, ships);
+//
+#define MM_METHOD(name) mm_method_ ## name {}
 
 /**********************************************************************************************/
 // Adds implementation of a method.
@@ -241,6 +470,34 @@
 //
 #define match(...) , +[](__VA_ARGS__) -> ret_type_t
 
+/**********************************************************************************************/
+// Adds implementation of a method with two parameters, that is used for both orders of
+// arguments. Swapped order is resolved while the table of implementations is built, so it
+// costs the same as the direct one.
+//
+//   match_sym(asteroid&, spaceship&) { cout << "Boom!\n"; } // collide(a, s) and collide(s, a)
+//
+#define match_sym(...) , ::multimethods::detail::symmetric_t() * +[](__VA_ARGS__) -> ret_type_t
+
+/**********************************************************************************************/
+// Adds implementations that are combined with the primary one (CLOS-style). All applicable
+// 'match_before' ones run before it (the most specific first), 'match_after' ones run after it
+// (the least specific first), and 'match_around' ones wrap all of them (the most specific
+// first, 'call_next_method' calls the next around one or the rest of the combination):
+//
+//   match_before(spaceship& s, thing&) { s.shields_up(); }
+//   match_after(thing& a, thing&) { log(a); }
+//   match_around(thing&, thing&) { lock l(m); return call_next_method; }
+//
+// Applicable qualified implementations are found once per tuple of dynamic types and cached,
+// so a combined call is one lookup and a run of direct calls. Such calls aren't traced or
+// profiled.
+//
+#define match_before(...) , ::multimethods::detail::before_t() * +[](__VA_ARGS__) -> void
+#define match_after(...) , ::multimethods::detail::after_t() * +[](__VA_ARGS__) -> void
+#define match_around(...) , ::multimethods::detail::around_t() * +[](__VA_ARGS__) -> ret_type_t
+#define call_next_method ::multimethods::detail::call_next_around<ret_type_t>()
+
 /**********************************************************************************************/
 // Finishes definition of a method.
 //
@@ -250,15 +507,74 @@
 //   end_method
 //
 #define end_method \
-            }); \
-            const auto methods = sorter.to_array<proto_t, ret_type_t, base1_t, base2_t, base3_t, base4_t, base5_t, base6_t>(); \
+        }) }; \
+        \
+        template<> \
+        struct dispatched<arity> final { \
+            static constexpr unsigned mask = g_sorter.dispatched_mask<proto_t>(); \
+        }; \
+        \
+        template<> \
+        struct qualifiers<arity> final { \
+            using hook_t = abstract_method<void, base1_t, base2_t, base3_t, base4_t, base5_t, base6_t>; \
+            \
+            static constexpr int befores = decltype(g_sorter)::qualified_count<before_t>(); \
+            static constexpr int afters  = decltype(g_sorter)::qualified_count<after_t>(); \
+            static constexpr int arounds = decltype(g_sorter)::qualified_count<around_t>(); \
+            static constexpr bool enabled = befores + afters + arounds > 0; \
+            static_assert(arity > 0 || !enabled, "Qualified implementations need parameters."); \
+            \
+            static inline hook_t* hooks_[befores + afters + 1]; /* Befores, then afters in reverse order */ \
+            static inline method_t* arounds_[arounds + 1]; \
+            \
+            struct primary final { \
+                using proto_traits_t = function_traits<proto_t>; \
+                static const method_data<method_t>& data() { return g_data; } \
+            }; \
             \
-            for(auto it: methods) \
-                if(it->is_fallback()) { \
-                    g_fallback = it; \
-                } else { \
-                    *g_impls_end++ = it; \
+            static void init() { \
+                if constexpr(enabled) { \
+                    g_sorter.make_qualified<before_t, proto_t>(hooks_); \
+                    g_sorter.make_qualified<after_t, proto_t>(hooks_ + befores); \
+                    std::reverse(hooks_ + befores, hooks_ + befores + afters); \
+                    g_sorter.make_qualified<around_t, proto_t>(arounds_); \
                 } \
+            } \
+            \
+            template<class... A> \
+            static ret_type_t call(A&... args) { \
+                return qualified_call<qualifiers, primary, g_cache, dispatched<arity>::mask>(std::index_sequence_for<A...>(), args...); \
+            } \
+        }; \
+        \
+        template<> \
+        struct sealed<arity> final { \
+            static constexpr bool enabled = sealed_method<proto_t, dispatched<arity>::mask>(std::make_index_sequence<arity>()) && !qualifiers<arity>::enabled; \
+            \
+            template<class... A> \
+            static auto call(bool& handled, A&... args) { \
+                return sealed_dispatch<g_sorter, proto_t, dispatched<arity>::mask, ret_type_t>(handled, args...); \
+            } \
+            \
+            /* Nested switch by known indexes of classes, 'L' is its leaf (see 'tag_route') */ \
+            template<class L, class... A> \
+            static typename L::result_t visit(const int* indexes, A&... args) { \
+                return sealed_switch<g_sorter, proto_t, dispatched<arity>::mask, L>::call(indexes, args...); \
+            } \
+        }; \
+        \
+        const bool g_init = [] { \
+            const auto methods = g_sorter.to_array<proto_t, ret_type_t, base1_t, base2_t, base3_t, base4_t, base5_t, base6_t>(); \
+            \
+            qualifiers<arity>::init(); \
+            register_impls(methods.data(), static_cast<int>(methods.size()), g_impls, g_impls_end, g_fallback, g_info, g_cache, \
+                           dispatched<arity>::mask, &decltype(g_sorter)::covers, direct_calls<g_sorter>(methods).data()); \
+            \
+            g_info.disjoint_ = &decltype(g_sorter)::disjoint; \
+            g_info.reorder_ = [](const std::vector<int>& order) { \
+                reorder_method(order, g_impls, g_impls_end, g_cache, g_descs, dispatched<arity>::mask, &decltype(g_sorter)::covers); \
+            }; \
+            g_info.complete(); \
             \
             return true; \
         }(); \
@@ -279,6 +595,117 @@
 //
 #define next_method throw ::multimethods::detail::try_next();
 
+/**********************************************************************************************/
+// Hooks of dispatchers to collect trace records, define MM_ENABLE_TRACE before including
+// of this file to enable them (see 'drain_trace' and 'dump_trace').
+//
+#ifdef MM_ENABLE_TRACE
+    #define MM_TRACE_BEGIN(...) ::multimethods::detail::trace_scope mm_trace(g_info.id_, { __VA_ARGS__ });
+    #define MM_TRACE_PROBE ++mm_trace.record_.probes_;
+    #define MM_TRACE_SELECT mm_trace.record_.impl_ = static_cast<std::int8_t>((*m)->index_);
+    #define MM_TRACE_NEXT ++mm_trace.record_.next_;
+    #define MM_TRACE_FALLBACK mm_trace.record_.flags_ |= ::multimethods::trace_record::used_fallback;
+#else
+    #define MM_TRACE_BEGIN(...)
+    #define MM_TRACE_PROBE
+    #define MM_TRACE_SELECT
+    #define MM_TRACE_NEXT
+    #define MM_TRACE_FALLBACK
+#endif
+
+/**********************************************************************************************/
+// Hooks of dispatchers to measure time of dispatching and time of implementations' bodies,
+// define MM_ENABLE_PROFILE before including of this file to enable them (see 'dump_profile').
+//
+#ifdef MM_ENABLE_PROFILE
+    #define MM_PROFILE_BEGIN ::multimethods::detail::profile_scope mm_profile(g_info);
+    #define MM_PROFILE_SELECT ::multimethods::detail::profile_selected() = ::multimethods::detail::timestamp();
+    #define MM_PROFILE_NEXT mm_profile.next();
+    #define MM_PROFILE_END(n) mm_profile.done(static_cast<int>(n));
+#else
+    #define MM_PROFILE_BEGIN
+    #define MM_PROFILE_SELECT
+    #define MM_PROFILE_NEXT
+    #define MM_PROFILE_END(n)
+#endif
+
+/**********************************************************************************************/
+// Calls the fallback or throws 'not_implemented' when no implementation accepts arguments. The
+// code is shared by dispatchers of all methods with the same types of parameters, except of
+// traced and profiled ones, that record the fallback.
+//
+#if defined(MM_ENABLE_TRACE) || defined(MM_ENABLE_PROFILE)
+    #define MM_CALL_FALLBACK(name) \
+        if(g_fallback) { \
+            MM_TRACE_FALLBACK \
+            if(auto r = g_fallback->call(arg<base1_t> { g_dummy_fallback })) { \
+                MM_PROFILE_END(g_impls_end - g_impls) \
+                return method_result<ret_type_t>::unwrap(r); \
+            } \
+        } \
+        throw_not_implemented(name ": not implemented.");
+#else
+    #define MM_CALL_FALLBACK(name) \
+        return dispatch_fallback<ret_type_t, base1_t>(g_fallback, name ": not implemented.");
+#endif
+
+/**********************************************************************************************/
+// Dispatches calls with arguments of sealed hierarchies by a nested switch, that calls bodies of
+// implementations directly. Calls aren't traced and profiled, so it's disabled with hooks.
+//
+#if defined(MM_ENABLE_TRACE) || defined(MM_ENABLE_PROFILE)
+    #define MM_SEALED_DISPATCH(name, ...)
+#else
+    #define MM_SEALED_DISPATCH(name, ...) \
+        if constexpr(sealed<N>::enabled) { \
+            if(!dispatch_cache_base::recording().load(std::memory_order_relaxed)) { \
+                bool handled = false; \
+                if(auto r = sealed<N>::call(handled, __VA_ARGS__)) { \
+                    return method_result<ret_type_t>::unwrap(r); \
+                } \
+                if(handled) { \
+                    throw_not_implemented(name ": not implemented."); \
+                } \
+            } \
+        }
+#endif
+
+/**********************************************************************************************/
+// Calls methods with before, after or around implementations (see 'match_before').
+//
+#define MM_QUALIFIED_DISPATCH(...) \
+    if constexpr(qualifiers<N>::enabled) { \
+        return qualifiers<N>::call(__VA_ARGS__); \
+    }
+
+/**********************************************************************************************/
+// Declares a closed hierarchy: all classes, that may be dynamic types of its objects. Methods,
+// all dispatched parameters of which are references to sealed hierarchies, find implementations
+// by a nested switch over indexes of classes and call them directly (so small bodies can be
+// inlined), instead of the table of implementations. Hierarchies of more than 32 classes (with
+// the base) and methods with more than MM_SEALED_MAX_TUPLES tuples of classes use the dispatch
+// cache. Use it after definitions of classes:
+//
+//   MM_SEALED(thing, asteroid, spaceship)
+//
+#define MM_SEALED(base, ...) \
+    ::multimethods::detail::sealed_types<base, __VA_ARGS__> mm_sealed(const base*);
+
+/**********************************************************************************************/
+// Declares a tag of a class without virtual functions. Such hierarchies are dispatched by tags
+// instead of vtables: 'mm_type_id(const base&)' (found by ADL) returns the tag of an object, and
+// MM_SEALED lists all classes, each with its own tag. Hierarchies that are too large for the
+// switch of MM_SEALED are dispatched by the cache, with classes found by tags:
+//
+//   struct shape { std::uint8_t kind; };
+//   struct circle : shape { MM_TYPE_ID(1) };
+//   inline std::uint8_t mm_type_id(const shape& s) { return s.kind; }
+//   MM_SEALED(shape, circle, square)
+//
+#define MM_TYPE_ID(id) \
+    public: \
+    static constexpr auto mm_type_id_value = (id);
+
 /**********************************************************************************************/
 // Macro to optimize casting of polymorphic classes
 //
@@ -313,10 +740,33 @@ struct not_implemented final : std::exception {
     const char* what() const noexcept final { return name_.c_str(); }
 };
 
+/**********************************************************************************************/
+// Exception to notify that a dispatch handle (or a route) is called with arguments of other
+// dynamic types than it was resolved for (checked only if NDEBUG is not defined).
+//
+struct bad_handle final : std::exception {
+    std::string name_;
+    explicit bad_handle(const char* name) : name_(name) {}
+
+    const char* what() const noexcept final { return name_.c_str(); }
+};
+
 
 /**********************************************************************************************/
 namespace detail {
 
+/**********************************************************************************************/
+// Shared by dispatchers of all methods, so each of them doesn't build the exception itself.
+//
+[[noreturn]] MM_COLD inline void throw_not_implemented(const char* message) {
+    throw not_implemented(message);
+}
+
+// The same for algorithms that get methods as objects and know only names of methods.
+[[noreturn]] MM_COLD inline void throw_method_not_implemented(const char* name) {
+    throw not_implemented((std::string(name) + ": not implemented.").c_str());
+}
+
 /**********************************************************************************************/
 using std::array;
 using std::conditional_t;
@@ -328,7 +778,6 @@ using std::is_polymorphic_v;
 using std::is_reference_v;
 using std::is_same_v;
 using std::optional;
-using std::sort;
 using std::remove_reference_t;
 
 /**********************************************************************************************/
@@ -336,845 +785,5165 @@ struct fallback_t {}; // Type to use as parameter of a fallback function (to det
 struct none_t {}; // Type to mark non-used parameters.
 
 /**********************************************************************************************/
-static inline fallback_t g_dummy_fallback;
-static inline int g_class_id_counter = 0;
-
+// Symmetric implementation, see 'match_sym'.
+//
+struct symmetric_t {};
 
 /**********************************************************************************************/
-// Helper function to cast of instances of class' that used MM_CLASS macro
-//
-template<class... Args>
-constexpr enable_if_t<sizeof...(Args) == 0, bool>
-match_class_id(int /*n*/) {
-    return false;
-}
+template<class F>
+struct symmetric final {
+    const F f_;
+};
 
 /**********************************************************************************************/
-template<class T, class... Args>
-constexpr bool match_class_id(int n) {
-    return T::mm_class_id == n || match_class_id<Args...>(n);
+template<class F>
+constexpr symmetric<F> operator*(symmetric_t /*tag*/, F f) {
+    return symmetric<F> { f };
 }
 
 /**********************************************************************************************/
-template <class T, class = int>
-struct has_class_info : std::false_type {};
+// Implementation with swapped parameters, created from a symmetric one.
+//
+template<class F>
+struct swapped;
 
 /**********************************************************************************************/
-template <class T>
-struct has_class_info<T, decltype((void) T::mm_class_id, 0)> : std::true_type {};
+template<class R, class T1, class T2>
+struct swapped<R(*)(T1, T2)> final {
+    using signature_t = R(*)(T2, T1);
 
+    R(* const f_)(T1, T2);
+    constexpr R operator()(T2 p2, T1 p1) const { return f_(static_cast<T1>(p1), static_cast<T2>(p2)); }
+};
 
 /**********************************************************************************************/
-// An argument for polymorphic type.
-//
-template<class B>
-struct arg_poly {
-    B* const base_ { nullptr };
-    constexpr arg_poly() = default;
-
-    constexpr explicit arg_poly(B& v)
-    : base_(&v) {
-    }
-
-    template<class T>
-    constexpr enable_if_t<is_same_v<decay_t<T>, decay_t<B>>, B*> cast() const {
-        return base_;
-    }
-
-    template<class T, class TD = remove_reference_t<T>>
-    constexpr enable_if_t<!is_same_v<decay_t<T>, decay_t<B>>, TD*> cast() const {
-        TD* r;
-
-        // Fallback
-        if constexpr(is_same_v<decay_t<T>, fallback_t>) {
-            r = &g_dummy_fallback;
-        }
-        // Class with MM_CLASS macro
-        else if constexpr(has_class_info<decay_t<T>>::value) {
-            r = reinterpret_cast<TD*>(base_->mm_cast(decay_t<T>::mm_class_id));
-        }
-        // Class without MM_CLASS macro
-        else {
-            r = dynamic_cast<TD*>(base_);
-        }
-
-        return r;
-    }
+template<class F>
+struct signature {
+    using type = F;
 };
 
 /**********************************************************************************************/
-// An argument for non-polymorphic type.
-//
-template<class B>
-struct arg_non_poly {
-    B* const p_ { nullptr };
-    constexpr arg_non_poly() = default;
-
-    constexpr explicit arg_non_poly(B& v)
-    : p_(&v) {
-    }
-
-    template<class T>
-    constexpr auto cast() const {
-        remove_reference_t<T>* r;
-
-        // Fallback
-        if constexpr(is_same_v<decay_t<T>, fallback_t>) {
-            r = &g_dummy_fallback;
-        }
-        // Value
-        else {
-            r = p_;
-        }
-
-        return r;
-    }
+template<class F>
+struct signature<swapped<F>> {
+    using type = typename swapped<F>::signature_t;
 };
 
 /**********************************************************************************************/
-// Dummy void argument.
+// Qualified implementations, see 'match_before', 'match_after' and 'match_around'.
 //
-struct arg_void {
-    template<class T>
-    constexpr remove_reference_t<T>* cast() const { return nullptr; }
-};
+struct before_t {};
+struct after_t {};
+struct around_t {};
 
 /**********************************************************************************************/
-// An argument for a method's implementation.
-//
-template<
-    class B,
-    class U = remove_reference_t<B>,
-    class S = conditional_t<is_same_v<B, void>,
-                  arg_void,
-                  conditional_t<is_polymorphic_v<decay_t<U>>, arg_poly<U>, arg_non_poly<U>>>
->
-struct arg final : S {
-    constexpr explicit arg(fallback_t /*dummy*/) {}
-    constexpr explicit arg(B& v) : S(v) {}
+template<class Q, class F>
+struct qualified final {
+    const F f_;
+
+    template<class... A>
+    constexpr decltype(auto) operator()(A&&... args) const { return f_(std::forward<A>(args)...); }
 };
 
+/**********************************************************************************************/
+template<class F> constexpr qualified<before_t, F> operator*(before_t /*tag*/, F f) { return { f }; }
+template<class F> constexpr qualified<after_t, F> operator*(after_t /*tag*/, F f) { return { f }; }
+template<class F> constexpr qualified<around_t, F> operator*(around_t /*tag*/, F f) { return { f }; }
 
 /**********************************************************************************************/
-// Exception to skip an implementation and try next one.
-//
-struct try_next final : std::exception {
-    const char* what() const noexcept final { return "next_method"; }
+template<class Q, class F>
+struct signature<qualified<Q, F>> {
+    using type = F;
 };
 
-
 /**********************************************************************************************/
-// Helper class to wrap a reference.
+// Qualifier of an implementation, void for primary ones.
 //
-template<class U>
-struct optional_ref {
-    optional_ref() : p_(nullptr) {}
-    explicit optional_ref(U v) : p_(&v) {}
-
-    explicit operator bool() const { return p_; }
-    U operator *() const { return static_cast<U>(*p_); }
-
-    remove_reference_t<U>* p_;
+template<class F>
+struct qualifier {
+    using type = void;
 };
 
 /**********************************************************************************************/
-template<class T, class B = conditional_t<
-    is_reference_v<T>,
-    optional_ref<T>,
-    optional<remove_reference_t<T>>>
->
-struct method_ret_type final : B {
-    method_ret_type() = default;
-    explicit method_ret_type(T&& v) : B(std::forward<T>(v)) {}
+template<class Q, class F>
+struct qualifier<qualified<Q, F>> {
+    using type = Q;
 };
 
-
 /**********************************************************************************************/
-// Base class for methods' implementations.
-//
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6>
-struct abstract_method {
-    using ret_t = conditional_t<is_same_v<T, void>, bool, method_ret_type<T>>;
-    virtual ret_t call() { return {}; }
-    virtual ret_t call(arg<B1> /*p1*/) { return {}; }
-    virtual ret_t call(arg<B1> /*p1*/, arg<B2> /*p2*/) { return {}; }
-    virtual ret_t call(arg<B1> /*p1*/, arg<B2> /*p2*/, arg<B3> /*p3*/) { return {}; }
-    virtual ret_t call(arg<B1> /*p1*/, arg<B2> /*p2*/, arg<B3> /*p3*/, arg<B4> /*p4*/) { return {}; }
-    virtual ret_t call(arg<B1> /*p1*/, arg<B2> /*p2*/, arg<B3> /*p3*/, arg<B4> /*p4*/, arg<B5> /*p5*/) { return {}; }
-    virtual ret_t call(arg<B1> /*p1*/, arg<B2> /*p2*/, arg<B3> /*p3*/, arg<B4> /*p4*/, arg<B5> /*p5*/, arg<B6> /*p6*/) { return {}; }
-    virtual bool is_fallback() const { return false; }
-};
-
+template<class F>
+using signature_t = typename signature<F>::type;
 
 /**********************************************************************************************/
-template<class... Args> constexpr enable_if_t<sizeof...(Args) == 0, bool> check_types() { return false; }
-template<class T1> constexpr bool check_types() { return false; }
-template<class T1, class T2, class T3> constexpr bool check_types() { return false; }
-template<class T1, class T2, class T3, class T4, class T5> constexpr bool check_types() { return false; }
-template<class T1, class T2, class T3, class T4, class T5, class T6, class T7> constexpr bool check_types() { return false; }
-template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9> constexpr bool check_types() { return false; }
-template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11> constexpr bool check_types() { return false; }
+template<class F>
+constexpr auto expand_implementation(F f) {
+    return std::tuple<F>(f);
+}
 
 /**********************************************************************************************/
-template<class T, class U>
-constexpr bool check_types() {
-    static_assert(is_reference_v<T> == is_reference_v<U>, "Implementation cannot add/remove reference to a parameter's type.");
-    static_assert(is_const_v<remove_reference_t<T>> == is_const_v<remove_reference_t<U>>, "Implementation cannot add/remove const to a parameter's type.");
-
-    if constexpr(!is_same_v<decay_t<T>, decay_t<U>>) {
-        static_assert(is_reference_v<T>, "Need to use reference to specify a parameter's type.");
-        static_assert(is_polymorphic_v<decay_t<T>> && is_base_of_v<decay_t<T>, decay_t<U>>, "Implementation can specify parameter's type, but not replace it.");
+template<class R, class T1, class T2>
+constexpr auto expand_implementation(symmetric<R(*)(T1, T2)> s) {
+    // The same types - swapped version is redundant
+    if constexpr(is_same_v<decay_t<T1>, decay_t<T2>>) {
+        return std::tuple<R(*)(T1, T2)>(s.f_);
+    } else {
+        return std::tuple<R(*)(T1, T2), swapped<R(*)(T1, T2)>>(s.f_, swapped<R(*)(T1, T2)> { s.f_ });
     }
-
-    return true;
 }
 
 /**********************************************************************************************/
-template<class T1, class T2, class U1, class U2>
-constexpr bool check_types() {
-    return check_types<T1, U1>() &&
-           check_types<T2, U2>();
+template<class F>
+constexpr auto expand_implementation(symmetric<F> /*s*/) {
+    static_assert(sizeof(F) == 0, "Symmetric implementation should have two parameters.");
+    return std::tuple<>();
 }
 
 /**********************************************************************************************/
-template<class T1, class T2, class T3, class U1, class U2, class U3>
-constexpr bool check_types() {
-    return check_types<T1, U1>() &&
-           check_types<T2, T3, U2, U3>();
+// Replaces each symmetric implementation with two ones for both orders of parameters.
+//
+template<class... Funcs>
+constexpr auto expand_symmetric(std::tuple<bool, Funcs...>&& funcs) {
+    return std::apply([](bool b, auto... f) {
+        return std::tuple_cat(std::tuple<bool>(b), expand_implementation(f)...);
+    }, funcs);
 }
 
 /**********************************************************************************************/
-template<class T1, class T2, class T3, class T4, class U1, class U2, class U3, class U4>
-constexpr bool check_types() {
-    return check_types<T1, U1>() &&
-           check_types<T2, T3, T4, U2, U3, U4>();
+static inline fallback_t g_dummy_fallback;
+static inline int g_class_id_counter = 0;
+
+/**********************************************************************************************/
+// Index of the lowest set bit, 'v' must not be zero.
+//
+inline int lowest_bit(std::uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int r = 0;
+    for( ; !(v & 1) ; v >>= 1) {
+        ++r;
+    }
+    return r;
+#endif
 }
 
 /**********************************************************************************************/
-template<class T1, class T2, class T3, class T4, class T5, class U1, class U2, class U3, class U4, class U5>
-constexpr bool check_types() {
-    return check_types<T1, U1>() &&
-           check_types<T2, T3, T4, T5, U2, U3, U4, U5>();
+constexpr int bits_count(unsigned v) {
+    int r = 0;
+    for( ; v ; v &= v - 1) {
+        ++r;
+    }
+    return r;
 }
 
 /**********************************************************************************************/
-template<class T1, class T2, class T3, class T4, class T5, class T6, class U1, class U2, class U3, class U4, class U5, class U6>
-constexpr bool check_types() {
-    return check_types<T1, U1>() &&
-           check_types<T2, T3, T4, T5, T6, U2, U3, U4, U5, U6>();
+// Bit mask of implementations' positions from 'impl' till 'count'.
+//
+constexpr std::uint64_t chain_between(int impl, int count) {
+    return impl < count ? (~std::uint64_t(0) << impl) & (~std::uint64_t(0) >> (64 - count)) : 0;
 }
 
+
+#if defined(MM_ENABLE_TRACE) || defined(MM_ENABLE_PROFILE)
+
 /**********************************************************************************************/
-template<class F1, class F2>
-struct check_parameters_impl;
+inline std::uint64_t timestamp() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
 
 /**********************************************************************************************/
-template<class R, class... Args1, class... Args2>
-struct check_parameters_impl<R(*)(Args1...), R(*)(Args2...)> {
-    static constexpr bool value = check_types<Args1..., Args2...>();
-};
+// Human readable name of a type.
+//
+inline std::string type_name(const std::type_info& type) {
+    std::string r = type.name();
+
+#if __has_include(<cxxabi.h>)
+    int status = 0;
+    if(char* s = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status)) {
+        r = s;
+        std::free(s);
+    }
+#endif
+
+    return r;
+}
+
+#endif // MM_ENABLE_TRACE || MM_ENABLE_PROFILE
+
+#ifdef MM_ENABLE_PROFILE
 
 /**********************************************************************************************/
-template<class R, class... Args>
-struct check_parameters_impl<R(*)(Args...), R(*)(fallback_t)> {
-    static constexpr bool value = true;
+// Histogram of durations in ticks, i-th bucket counts durations with i significant bits.
+//
+struct profile_histogram final {
+    static constexpr int size = 48;
+
+    std::atomic<std::uint64_t> count_ {};
+    std::atomic<std::uint64_t> sum_ {};
+    std::atomic<std::uint64_t> buckets_[size] {};
+
+    void add(std::uint64_t ticks) {
+        int bits = 0;
+#if defined(__GNUC__)
+        bits = ticks ? 64 - __builtin_clzll(ticks) : 0;
+#else
+        for(auto v = ticks ; v ; v >>= 1) {
+            ++bits;
+        }
+#endif
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ticks, std::memory_order_relaxed);
+        buckets_[bits < size ? bits : size - 1].fetch_add(1, std::memory_order_relaxed);
+    }
 };
 
 /**********************************************************************************************/
-template<class F1, class F2>
-struct check_parameters final : public check_parameters_impl<F1, F2> {
+struct impl_profile final {
+    profile_histogram dispatch_; // From the entry to a dispatcher till selecting of an implementation.
+    profile_histogram body_;     // Time of implementation's body.
 };
 
-
 /**********************************************************************************************/
-template<class... Args> constexpr enable_if_t<sizeof...(Args) == 0, int> compare_types() { return 0; }
-template<class> constexpr int compare_types() { return 0; }
-template<class, class, class> constexpr int compare_types() { return 0; }
-template<class, class, class, class, class> constexpr int compare_types() { return 0; }
-template<class, class, class, class, class, class, class> constexpr int compare_types() { return 0; }
-template<class, class, class, class, class, class, class, class, class> constexpr int compare_types() { return 0; }
-template<class, class, class, class, class, class, class, class, class, class, class> constexpr int compare_types() { return 0; }
+// Time when the last implementation was selected in the current thread.
+//
+inline std::uint64_t& profile_selected() {
+    static thread_local std::uint64_t r { 0 };
+    return r;
+}
 
 /**********************************************************************************************/
-template<class T, class U>
-constexpr int compare_types() {
-    using TD = decay_t<T>;
-    using UD = decay_t<U>;
+// Time when 'next_method' was called in the current thread, unwinding is not a part of a body.
+//
+inline std::uint64_t& profile_skipped() {
+    static thread_local std::uint64_t r { 0 };
+    return r;
+}
 
-    // The same types - just check constness
-    if constexpr(is_same_v<TD, UD>) {
-        return 0;
-    }
+#endif // MM_ENABLE_PROFILE
 
-    // Prefer derived classes
-    if constexpr (is_base_of_v<decay_t<T>, decay_t<U>>) {
-        return 1;
-    }
-    if constexpr(is_base_of_v<decay_t<U>, decay_t<T>>) {
-        return -1;
-    }
+/**********************************************************************************************/
+template<class T>
+void write_pod(std::FILE* f, T v) {
+    std::fwrite(&v, sizeof(v), 1, f);
+}
 
-    return 0;
+/**********************************************************************************************/
+inline void write_string(std::FILE* f, const char* s) {
+    const auto n = static_cast<std::uint16_t>(std::strlen(s));
+    write_pod(f, n);
+    std::fwrite(s, 1, n, f);
 }
 
 /**********************************************************************************************/
-template<class T1, class T2, class U1, class U2>
-constexpr int compare_types() {
-    if(constexpr int r = compare_types<T1, U1>() ) {
-        return r;
-    }
-    return compare_types<T2, U2>();
+template<class T>
+bool read_pod(std::FILE* f, T& v) {
+    return std::fread(&v, sizeof(v), 1, f) == 1;
 }
 
 /**********************************************************************************************/
-template<class T1, class T2, class T3, class U1, class U2, class U3>
-constexpr int compare_types() {
-    if(constexpr int r = compare_types<T1, U1>() ) {
-        return r;
+inline bool read_string(std::FILE* f, std::string& s) {
+    std::uint16_t n;
+    if(!read_pod(f, n)) {
+        return false;
     }
-    return compare_types<T2, T3, U2, U3>();
+    s.resize(n);
+    return std::fread(&s[0], 1, n, f) == n;
 }
 
+
 /**********************************************************************************************/
-template<class T1, class T2, class T3, class T4, class U1, class U2, class U3, class U4>
-constexpr int compare_types() {
-    if(constexpr int r = compare_types<T1, U1>() ) {
+// Type-erased interface of dispatch caches, for tools working with all multimethods.
+//
+struct dispatch_cache_base {
+    struct tuple_t final {
+        const std::type_info* types_[6];
+        int impl_;              // Position of the first applicable implementation.
+        std::uint64_t chain_;   // Positions of all applicable implementations.
+        std::uint32_t hits_;    // Count of calls, if recording is enabled.
+    };
+
+    // Preloaded chains for types, that aren't known yet, by joined names of types.
+    std::unordered_map<std::string, std::uint64_t> warm_;
+
+    std::atomic<std::size_t> bytes_ { 0 };          // Memory of current and replaced tables.
+    std::atomic<std::size_t> budget_ { SIZE_MAX };  // Limit of 'bytes_' for the method.
+    std::atomic<std::uint64_t> evictions_ { 0 };    // Tuples replaced by other ones.
+    std::atomic<std::uint64_t> denied_ { 0 };       // Growths refused because of budgets.
+
+    virtual ~dispatch_cache_base() = default;
+    virtual void clear() = 0;
+    virtual void insert(const std::type_info* const* types, std::uint64_t chain) = 0;
+    virtual void tuples(std::vector<tuple_t>& out) const = 0;
+
+    // Counting of calls for each tuple.
+    static std::atomic<bool>& recording() {
+        static std::atomic<bool> r { false };
         return r;
     }
-    return compare_types<T2, T3, T4, U2, U3, U4>();
-}
 
-/**********************************************************************************************/
-template<class T1, class T2, class T3, class T4, class T5, class U1, class U2, class U3, class U4, class U5>
-constexpr int compare_types() {
-    if(constexpr int r = compare_types<T1, U1>() ) {
+    // Memory of caches of all multimethods.
+    static std::atomic<std::size_t>& total_bytes() {
+        static std::atomic<std::size_t> r { 0 };
         return r;
     }
-    return compare_types<T2, T3, T4, T5, U2, U3, U4, U5>();
-}
 
-/**********************************************************************************************/
-template<class T1, class T2, class T3, class T4, class T5, class T6, class U1, class U2, class U3, class U4, class U5, class U6>
-constexpr int compare_types() {
-    if(constexpr int r = compare_types<T1, U1>() ) {
+    static std::atomic<std::size_t>& total_budget() {
+        static std::atomic<std::size_t> r { MM_CACHE_BUDGET };
         return r;
     }
-    return compare_types<T2, T3, T4, T5, T6, U2, U3, U4, U5, U6>();
-}
 
-/**********************************************************************************************/
-template<class F1, class F2>
-struct compare_functions_impl;
+    // Accounts memory for a new table if it fits into both budgets.
+    bool reserve(std::size_t bytes) {
+        std::size_t used = bytes_.load(std::memory_order_relaxed);
+        do {
+            if(used + bytes > budget_.load(std::memory_order_relaxed)) {
+                return false;
+            }
+        } while(!bytes_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
 
-/**********************************************************************************************/
-template<class R, class... Args1, class... Args2>
-struct compare_functions_impl<R(*)(Args1...), R(*)(Args2...)> {
-    static constexpr int value = compare_types<Args1..., Args2...>();
-};
+        std::size_t total = total_bytes().load(std::memory_order_relaxed);
+        do {
+            if(total + bytes > total_budget().load(std::memory_order_relaxed)) {
+                bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+                return false;
+            }
+        } while(!total_bytes().compare_exchange_weak(total, total + bytes, std::memory_order_relaxed));
 
-/**********************************************************************************************/
-template<>
-struct compare_functions_impl<void, void> {
-    static constexpr int value = 0;
-};
+        return true;
+    }
 
-/**********************************************************************************************/
-template<class F1, class F2>
-struct compare_functions final : public compare_functions_impl<F1, F2> {
-};
+    // The first table of each cache is always allocated.
+    void account(std::size_t bytes) {
+        bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        total_bytes().fetch_add(bytes, std::memory_order_relaxed);
+    }
 
+    void release(std::size_t bytes) {
+        bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+        total_bytes().fetch_sub(bytes, std::memory_order_relaxed);
+    }
 
-/**********************************************************************************************/
+    static std::string join_names(const std::type_info* const* types, int count) {
+        std::string r;
+        for(int i = 0 ; i < count ; ++i) {
+            r += types[i] ? types[i]->name() : "";
+            r += '\n';
+        }
+        return r;
+    }
+};
+
+
+/**********************************************************************************************/
+// Information about a multimethod for diagnostic tools.
+//
+struct method_info final {
+    const char* const name_;
+    const int arity_;
+    const int id_;
+    std::vector<const std::type_info*> signatures_; // Implementations in order of registration.
+    std::vector<const std::type_info*> types_;      // All types of implementations' parameters.
+    std::vector<int> sources_;                      // Indexes of implementations in a definition.
+    std::vector<int> order_;                        // Indexes of implementations in order of dispatching.
+
+    dispatch_cache_base* cache_ { nullptr };
+    bool (*disjoint_)(int, int) { nullptr };                // Implementations never apply to the same arguments.
+    void (*reorder_)(const std::vector<int>&) { nullptr };  // Changes order of dispatching.
+
+#ifdef MM_ENABLE_PROFILE
+    std::unique_ptr<impl_profile[]> profile_; // For each implementation and the fallback.
+#endif
+
+    method_info(const char* name, int arity)
+    : name_(name), arity_(arity), id_(static_cast<int>(methods().size())) {
+        methods().push_back(this);
+    }
+
+    void add_impl(const std::type_info* signature, const std::type_info* const* types, int source) {
+        order_.push_back(static_cast<int>(signatures_.size()));
+        signatures_.push_back(signature);
+        sources_.push_back(source);
+
+        for(int i = 0 ; i < 6 ; ++i) {
+            if(types[i] && std::find(types_.begin(), types_.end(), types[i]) == types_.end()) {
+                types_.push_back(types[i]);
+            }
+        }
+    }
+
+    // Checks that implementations (by indexes of registration) never apply to the same arguments.
+    bool disjoint(int a, int b) const { return disjoint_(sources_[a], sources_[b]); }
+
+    // Called when all implementations are registered.
+    void complete() {
+#ifdef MM_ENABLE_PROFILE
+        profile_.reset(new impl_profile[signatures_.size() + 1]());
+#endif
+    }
+
+    method_info(const method_info&) = delete;
+    method_info& operator=(const method_info&) = delete;
+
+    // All multimethods of a program.
+    static std::vector<method_info*>& methods() {
+        static std::vector<method_info*> r;
+        return r;
+    }
+};
+
+
+/**********************************************************************************************/
+// Perfect hash from exact types of implementations' parameters (by dispatched positions) to
+// implementations that may apply to arguments of these dynamic types. It's built when all
+// implementations are registered and isn't changed by calls, so a call with arguments of the
+// types named by a 'match' takes one probe. A seed is searched to avoid collisions, the table
+// is enlarged if there is no such seed.
+//
+template<int N>
+class exact_table final {
+public:
+    static constexpr int seeds = 32;
+
+    exact_table() : slots_(1) {}
+
+    // 'covers(a, b)' - implementation 'a' may apply to arguments of parameters' types of 'b',
+    // by indexes in a definition.
+    template<class M>
+    void build(M** impls, M** impls_end, unsigned mask, bool (*covers)(int, int)) {
+        std::vector<slot> keys;
+        const int count = static_cast<int>(impls_end - impls);
+
+        for(int i = 0 ; mask && i < count ; ++i) {
+            slot s;
+            for(int k = 0 ; k < N ; ++k) {
+                s.types_[k] = mask & (1u << k) ? impls[i]->types_[k] : nullptr;
+            }
+            if(std::find_if(keys.begin(), keys.end(), [&s](const slot& o) { return equal(o, s.types_); }) != keys.end()) {
+                continue;
+            }
+
+            for(int j = 0 ; j < count ; ++j) {
+                s.chain_ |= covers(impls[j]->source_, impls[i]->source_) ? std::uint64_t(1) << j : 0;
+            }
+            s.impl_ = lowest_bit(s.chain_);
+            keys.push_back(s);
+        }
+
+        std::size_t size = 1;
+        while(size < 2 * keys.size()) {
+            size *= 2;
+        }
+
+        for( ; !keys.empty() && size <= 2 * keys.size() * keys.size() ; size *= 2) {
+            for(std::uint64_t seed = 1 ; seed <= seeds ; ++seed) {
+                std::vector<slot> slots(size);
+                bool collision = false;
+
+                for(const slot& s : keys) {
+                    slot& to = slots[index(s.types_, seed) & (size - 1)];
+                    collision = collision || to.impl_ >= 0;
+                    to = s;
+                }
+
+                if(!collision) {
+                    slots_ = std::move(slots);
+                    seed_ = seed;
+                    mask_ = size - 1;
+                    return;
+                }
+            }
+        }
+
+        slots_.assign(1, slot());
+        mask_ = 0;
+    }
+
+    // Returns position of the first implementation that may apply or -1.
+    int find(const std::type_info* const* types) const {
+        const slot& s = slots_[index(types, seed_) & mask_];
+        return equal(s, types) ? s.impl_ : -1;
+    }
+
+    // Returns implementations that may apply, or nullptr if types aren't in the table.
+    const std::uint64_t* chain(const std::type_info* const* types) const {
+        const slot& s = slots_[index(types, seed_) & mask_];
+        return s.impl_ >= 0 && equal(s, types) ? &s.chain_ : nullptr;
+    }
+
+    std::size_t bytes() const { return slots_.size() * sizeof(slot); }
+
+private:
+    struct slot final {
+        const std::type_info* types_[N > 0 ? N : 1] {};
+        int impl_ { -1 };
+        std::uint64_t chain_ { 0 };
+    };
+
+    std::vector<slot> slots_;
+    std::uint64_t seed_ { 0 };
+    std::size_t mask_ { 0 };
+
+    static std::size_t index(const std::type_info* const* types, std::uint64_t seed) {
+        std::uint64_t h = seed;
+        for(int i = 0 ; i < N ; ++i) {
+            h = (h ^ reinterpret_cast<std::uintptr_t>(types[i])) * 0x9E3779B97F4A7C15ull;
+        }
+        return static_cast<std::size_t>(h ^ (h >> 29));
+    }
+
+    static bool equal(const slot& s, const std::type_info* const* types) {
+        bool r = true;
+        for(int i = 0 ; i < N ; ++i) {
+            r = r && s.types_[i] == types[i];
+        }
+        return r;
+    }
+};
+
+/**********************************************************************************************/
+// Lock-free cache from dynamic types of arguments to the chain of applicable implementations:
+// a bit mask of their positions. A dispatcher calls the lowest one, 'next_method' moves to
+// the next bit, so the cache never changes results of a call, it just skips implementations
+// that cannot be applied. Entries are protected with sequence counters, the table is doubled
+// when it is half full (old tables are kept till exit, readers may still use them).
+//
+// Tables grow only within the method's and the global budgets, after that a new tuple replaces
+// a cold one from its probe window (second chance: tuples hit since the last eviction are
+// spared once). Calls with evicted tuples find applicable implementations by descriptors of
+// arguments, as on the first call.
+//
+// Tuples of types named by implementations are looked up in a perfect hash first (unless calls
+// are counted), they never take memory of tables and are never evicted.
+//
+template<int N>
+class dispatch_cache final : public dispatch_cache_base {
+public:
+    struct key_t final {
+        const std::type_info* types_[N > 0 ? N : 1];
+    };
+
+    static constexpr int probes = 8;
+    static constexpr std::size_t initial_size = 16;
+    static constexpr std::size_t max_size = 1 << 16;
+
+    dispatch_cache()
+    : table_(new table(initial_size)) {
+        tables_.emplace_back(table_.load(std::memory_order_relaxed));
+        account(table::bytes(initial_size) + exact_.bytes());
+    }
+
+    explicit dispatch_cache(method_info& info)
+    : dispatch_cache() {
+        info.cache_ = this;
+    }
+
+    // Builds the perfect hash of exact types, when implementations are registered or reordered.
+    template<class M>
+    void build_exact(M** impls, M** impls_end, unsigned mask, bool (*covers)(int, int)) {
+        release(exact_.bytes());
+        exact_.build(impls, impls_end, mask, covers);
+        account(exact_.bytes());
+    }
+
+    // Returns position of the first applicable implementation or -1.
+    int find(const key_t& key) {
+        const int exact = exact_.find(key.types_);
+        if(exact >= 0 && !recording().load(std::memory_order_relaxed)) {
+            return exact;
+        }
+
+        const table* t = table_.load(std::memory_order_acquire);
+        std::size_t i = hash(key.types_);
+
+        for(int n = 0 ; n < probes ; ++n, ++i) {
+            entry& e = t->entries_[i & t->mask_];
+
+            const std::uint32_t version = e.version_.load(std::memory_order_acquire);
+            const int impl = e.impl_.load(std::memory_order_relaxed);
+            const bool same = equal(e, key.types_);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if((version & 1) || e.version_.load(std::memory_order_relaxed) != version) {
+                continue;
+            }
+            if(impl < 0) {
+                break;
+            }
+            if(same) {
+                if(!e.referenced_.load(std::memory_order_relaxed)) {
+                    e.referenced_.store(true, std::memory_order_relaxed);
+                }
+                if(recording().load(std::memory_order_relaxed)) {
+                    e.hits_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return impl;
+            }
+        }
+
+        return warm_.empty() ? -1 : find_warm(key);
+    }
+
+    // Returns applicable implementations after 'impl', for 'next_method'. Chains are kept
+    // apart from entries, so 'find' reads as little as possible. If the tuple was replaced,
+    // all implementations after 'impl' are tried.
+    std::uint64_t next(const key_t& key, int impl) const {
+        if(const std::uint64_t* chain = exact_.chain(key.types_)) {
+            return *chain & chain_between(impl + 1, 64);
+        }
+
+        const table* t = table_.load(std::memory_order_acquire);
+        std::size_t i = hash(key.types_);
+
+        for(int n = 0 ; n < probes ; ++n, ++i) {
+            const entry& e = t->entries_[i & t->mask_];
+
+            const std::uint32_t version = e.version_.load(std::memory_order_acquire);
+            const bool used = e.impl_.load(std::memory_order_relaxed) >= 0;
+            const std::uint64_t chain = t->chains_[i & t->mask_].load(std::memory_order_relaxed);
+            const bool same = equal(e, key.types_);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if((version & 1) || e.version_.load(std::memory_order_relaxed) != version) {
+                continue;
+            }
+            if(!used) {
+                break;
+            }
+            if(same) {
+                return chain & chain_between(impl + 1, 64);
+            }
+        }
+
+        return chain_between(impl + 1, 64);
+    }
+
+    // Adds a tuple with positions of applicable implementations, returns the first one
+    // (64 if there is none).
+    int insert(const key_t& key, std::uint64_t chain) {
+        insert(key.types_, chain);
+        return chain ? lowest_bit(chain) : 64;
+    }
+
+    void insert(const std::type_info* const* types, std::uint64_t chain) final {
+        table* t = table_.load(std::memory_order_acquire);
+        const std::size_t h = hash(types);
+
+        std::size_t slot = h;
+        bool fresh = false;
+        for(std::size_t i = h ; i < h + probes ; ++i) {
+            if(t->entries_[i & t->mask_].impl_.load(std::memory_order_relaxed) < 0) {
+                slot = i;
+                fresh = true;
+                break;
+            }
+        }
+
+        // No free entries around, replace a cold one
+        if(!fresh) {
+            slot = victim(*t, h);
+        }
+
+        if(!write(*t, slot & t->mask_, types, chain ? lowest_bit(chain) : 64, chain)) {
+            return;
+        }
+
+        if(!fresh) {
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        } else if(2 * (t->used_.fetch_add(1, std::memory_order_relaxed) + 1) > t->mask_ + 1) {
+            grow(t);
+        }
+    }
+
+    void clear() final {
+        table* t = table_.load(std::memory_order_acquire);
+        const std::type_info* none[N > 0 ? N : 1] {};
+
+        for(std::size_t i = 0 ; i <= t->mask_ ; ++i) {
+            write(*t, i, none, -1, 0);
+        }
+        t->used_.store(0, std::memory_order_relaxed);
+    }
+
+    void tuples(std::vector<tuple_t>& out) const final {
+        read_all(*table_.load(std::memory_order_acquire), [&out](const tuple_t& tuple) {
+            out.push_back(tuple);
+        });
+    }
+
+private:
+    struct entry final {
+        std::atomic<std::uint32_t> version_ { 0 }; // Odd while an entry is written.
+        std::atomic<int> impl_ { -1 };             // -1 for a free entry.
+        std::atomic<std::uint32_t> hits_ { 0 };
+        std::atomic<bool> referenced_ { false };   // Hit since the last eviction in its window.
+        std::atomic<const std::type_info*> types_[N > 0 ? N : 1] {};
+    };
+
+    struct table final {
+        const std::size_t mask_;
+        const std::unique_ptr<entry[]> entries_;
+        const std::unique_ptr<std::atomic<std::uint64_t>[]> chains_; // Guarded by versions of entries.
+        std::atomic<std::size_t> used_ { 0 };
+
+        explicit table(std::size_t size) : mask_(size - 1), entries_(new entry[size]), chains_(new std::atomic<std::uint64_t>[size]()) {}
+
+        static constexpr std::size_t bytes(std::size_t size) {
+            return sizeof(table) + size * (sizeof(entry) + sizeof(std::atomic<std::uint64_t>));
+        }
+    };
+
+    exact_table<N> exact_;
+    std::atomic<table*> table_;
+    std::vector<std::unique_ptr<table>> tables_; // Current and old tables, guarded by 'mutex_'.
+    std::mutex mutex_;
+
+    static std::size_t hash(const std::type_info* const* types) {
+        std::uint64_t h = 0;
+        for(int i = 0 ; i < N ; ++i) {
+            h = (h ^ reinterpret_cast<std::uintptr_t>(types[i])) * 0x9E3779B97F4A7C15ull;
+        }
+        return static_cast<std::size_t>(h ^ (h >> 29));
+    }
+
+    static bool equal(const entry& e, const std::type_info* const* types) {
+        bool r = true;
+        for(int i = 0 ; i < N ; ++i) {
+            r = r && e.types_[i].load(std::memory_order_relaxed) == types[i];
+        }
+        return r;
+    }
+
+    static bool write(table& t, std::size_t i, const std::type_info* const* types, int impl, std::uint64_t chain) {
+        entry& e = t.entries_[i];
+
+        std::uint32_t version = e.version_.load(std::memory_order_relaxed);
+        if((version & 1) || !e.version_.compare_exchange_strong(version, version + 1, std::memory_order_relaxed)) {
+            return false; // Another thread writes it
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(int k = 0 ; k < N ; ++k) {
+            e.types_[k].store(types[k], std::memory_order_relaxed);
+        }
+        e.impl_.store(impl, std::memory_order_relaxed);
+        t.chains_[i].store(chain, std::memory_order_relaxed);
+        e.hits_.store(impl < 0 ? 0 : 1, std::memory_order_relaxed);
+        e.referenced_.store(impl >= 0, std::memory_order_relaxed);
+
+        e.version_.store(version + 2, std::memory_order_release);
+        return true;
+    }
+
+    template<class F>
+    static void read_all(const table& t, F f) {
+        for(std::size_t i = 0 ; i <= t.mask_ ; ++i) {
+            const entry& e = t.entries_[i];
+
+            tuple_t tuple {};
+            const std::uint32_t version = e.version_.load(std::memory_order_acquire);
+            for(int k = 0 ; k < N ; ++k) {
+                tuple.types_[k] = e.types_[k].load(std::memory_order_relaxed);
+            }
+            tuple.impl_ = e.impl_.load(std::memory_order_relaxed);
+            tuple.chain_ = t.chains_[i].load(std::memory_order_relaxed);
+            tuple.hits_ = e.hits_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if(!(version & 1) && e.version_.load(std::memory_order_relaxed) == version && tuple.impl_ >= 0) {
+                f(tuple);
+            }
+        }
+    }
+
+    // Takes the first entry of a probe window that wasn't hit since it was passed last time.
+    static std::size_t victim(table& t, std::size_t h) {
+        for(std::size_t i = h ; i < h + probes ; ++i) {
+            if(!t.entries_[i & t.mask_].referenced_.exchange(false, std::memory_order_relaxed)) {
+                return i;
+            }
+        }
+        return h;
+    }
+
+    void grow(table* t) {
+        const std::size_t size = 2 * (t->mask_ + 1);
+        if(size > max_size) {
+            return;
+        }
+
+        if(!reserve(table::bytes(size))) {
+            denied_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if(table_.load(std::memory_order_relaxed) != t) {
+            release(table::bytes(size));
+            return;
+        }
+
+        auto bigger = std::make_unique<table>(size);
+        table* n = bigger.get();
+
+        read_all(*t, [n](const tuple_t& tuple) {
+            std::size_t i = hash(tuple.types_);
+            for(int k = 0 ; k < probes ; ++k, ++i) {
+                entry& e = n->entries_[i & n->mask_];
+                if(e.impl_.load(std::memory_order_relaxed) < 0) {
+                    write(*n, i & n->mask_, tuple.types_, tuple.impl_, tuple.chain_);
+                    e.hits_.store(tuple.hits_, std::memory_order_relaxed);
+                    n->used_.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        });
+
+        tables_.push_back(std::move(bigger));
+        table_.store(n, std::memory_order_release);
+    }
+
+    int find_warm(const key_t& key) {
+        const auto it = warm_.find(join_names(key.types_, N));
+        return it == warm_.end() ? -1 : insert(key, it->second);
+    }
+};
+
+/**********************************************************************************************/
+// Changes order of implementations, 'order' contains indexes of registration.
+//
+template<class M>
+void reorder_impls(M** impls, const std::vector<int>& order) {
+    const std::vector<M*> old(impls, impls + order.size());
+
+    for(std::size_t i = 0 ; i < order.size() ; ++i) {
+        for(auto m : old) {
+            if(m->index_ == order[i]) {
+                impls[i] = m;
+                m->position_ = static_cast<int>(i);
+            }
+        }
+    }
+}
+
+
+/**********************************************************************************************/
+// Helper function to cast of instances of class' that used MM_CLASS macro
+//
+template<class... Args>
+constexpr enable_if_t<sizeof...(Args) == 0, bool>
+match_class_id(int /*n*/) {
+    return false;
+}
+
+/**********************************************************************************************/
+template<class T, class... Args>
+constexpr bool match_class_id(int n) {
+    return T::mm_class_id == n || match_class_id<Args...>(n);
+}
+
+/**********************************************************************************************/
+template <class T, class = int>
+struct has_class_info : std::false_type {};
+
+/**********************************************************************************************/
+template <class T>
+struct has_class_info<T, decltype((void) T::mm_class_id, 0)> : std::true_type {};
+
+
+/**********************************************************************************************/
+// Cache of pointer adjustments for casts of polymorphic classes without MM_CLASS macro.
+// An entry is keyed by the most-derived type of an object and by the offset of the base
+// subobject inside of it, so a cast of an already seen object's layout is just a pointer
+// add. If the offset of the base subobject differs (repeated non-virtual bases) the entry
+// just doesn't match and 'dynamic_cast' is used to recompute it.
+//
+template<class B, class T>
+struct cast_cache final {
+    static constexpr int size = 16;
+    static constexpr std::ptrdiff_t no_cast = PTRDIFF_MIN;
+
+    struct entry {
+        const std::type_info* type_ { nullptr };
+        std::ptrdiff_t base_offset_ { 0 };
+        std::ptrdiff_t offset_ { 0 };
+    };
+
+    // Per-thread to be lock-free, an entry cannot be updated atomically.
+    static inline thread_local entry entries_[size];
+
+    // 'type' and 'top' are the dynamic type and the address of the most-derived object, if they
+    // are already known.
+    MM_NOINLINE static T* cast(B* base, const std::type_info* type, const char* top) {
+        if(!type) {
+            type = &typeid(*base);
+            top = static_cast<const char*>(dynamic_cast<const void*>(base));
+        }
+
+        const std::ptrdiff_t base_offset = reinterpret_cast<const char*>(base) - top;
+
+        const auto h = reinterpret_cast<std::uintptr_t>(type);
+        entry& e = entries_[((h >> 4) ^ (h >> 10)) & (size - 1)];
+
+        if(e.type_ != type || e.base_offset_ != base_offset) {
+            T* r = dynamic_cast<T*>(base);
+            e = { type, base_offset, r ? reinterpret_cast<const char*>(r) - top : no_cast };
+            return r;
+        }
+
+        return e.offset_ == no_cast ? nullptr : reinterpret_cast<T*>(const_cast<char*>(top) + e.offset_);
+    }
+};
+
+
+/**********************************************************************************************/
+// Casts of arguments of one dynamic type to parameters of all implementations of a method.
+//
+struct arg_desc final {
+    static constexpr std::ptrdiff_t no_cast = PTRDIFF_MIN;
+
+    const std::type_info* type_ { nullptr };
+    std::ptrdiff_t base_offset_ { 0 };    // Offset of the base subobject in the most-derived object.
+    std::uint64_t accepts_ { 0 };         // Bit i is set if i-th implementation accepts the argument.
+    std::ptrdiff_t offsets_[64];          // Offsets of parameters in the most-derived object.
+};
+
+/**********************************************************************************************/
+// Descriptors of dynamic types of arguments for one parameter of a method. A descriptor is
+// built on the first call with an argument of a type, then lookup is lock-free.
+//
+class arg_descs_base {
+public:
+    virtual ~arg_descs_base() = default;
+
+    const arg_desc* get(void* base, const std::type_info* type, std::ptrdiff_t base_offset) {
+        if(auto r = find(type, base_offset)) {
+            return r;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(auto r = find(type, base_offset)) {
+            return r;
+        }
+
+        auto desc = std::make_unique<arg_desc>();
+        desc->type_ = type;
+        desc->base_offset_ = base_offset;
+        build(*desc, base);
+
+        add(desc.get());
+        descs_.push_back(std::move(desc));
+        return descs_.back().get();
+    }
+
+    // Forgets all descriptors, when implementations are reordered.
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        table_.store(nullptr, std::memory_order_release);
+    }
+
+private:
+    struct table final {
+        const std::size_t mask_;
+        const std::unique_ptr<std::atomic<const arg_desc*>[]> slots_;
+        std::size_t used_ { 0 };
+
+        explicit table(std::size_t size) : mask_(size - 1), slots_(new std::atomic<const arg_desc*>[size]) {
+            for(std::size_t i = 0 ; i < size ; ++i) {
+                slots_[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::atomic<table*> table_ { nullptr };
+    std::vector<std::unique_ptr<table>> tables_;     // Current and old tables, guarded by 'mutex_'.
+    std::vector<std::unique_ptr<arg_desc>> descs_;   // Guarded by 'mutex_'.
+    std::mutex mutex_;
+
+    static std::size_t hash(const std::type_info* type, std::ptrdiff_t base_offset) {
+        const std::uint64_t h = (reinterpret_cast<std::uintptr_t>(type) ^ static_cast<std::uint64_t>(base_offset)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(h >> 32);
+    }
+
+    const arg_desc* find(const std::type_info* type, std::ptrdiff_t base_offset) const {
+        const table* t = table_.load(std::memory_order_acquire);
+        if(!t) {
+            return nullptr;
+        }
+
+        for(std::size_t i = hash(type, base_offset) ; ; ++i) {
+            const arg_desc* d = t->slots_[i & t->mask_].load(std::memory_order_acquire);
+            if(!d || (d->type_ == type && d->base_offset_ == base_offset)) {
+                return d;
+            }
+        }
+    }
+
+    // Tables are at most half full, so a probe always ends on an empty slot.
+    void add(const arg_desc* desc) {
+        table* t = table_.load(std::memory_order_relaxed);
+
+        if(!t || 2 * (t->used_ + 1) > t->mask_ + 1) {
+            auto bigger = std::make_unique<table>(t ? 2 * (t->mask_ + 1) : 16);
+            if(t) {
+                for(std::size_t i = 0 ; i <= t->mask_ ; ++i) {
+                    if(auto d = t->slots_[i].load(std::memory_order_relaxed)) {
+                        insert(*bigger, d);
+                    }
+                }
+            }
+            insert(*bigger, desc);
+            table_.store(bigger.get(), std::memory_order_release);
+            tables_.push_back(std::move(bigger));
+        } else {
+            insert(*t, desc);
+        }
+    }
+
+    static void insert(table& t, const arg_desc* desc) {
+        std::size_t i = hash(desc->type_, desc->base_offset_);
+        while(t.slots_[i & t.mask_].load(std::memory_order_relaxed)) {
+            ++i;
+        }
+        t.slots_[i & t.mask_].store(desc, std::memory_order_release);
+        ++t.used_;
+    }
+
+protected:
+    virtual void build(arg_desc& desc, void* base) const = 0;
+};
+
+/**********************************************************************************************/
+template<class M>
+class arg_descs final : public arg_descs_base {
+public:
+    arg_descs(M** impls, M** const* impls_end, int param)
+    : impls_(impls), impls_end_(impls_end), param_(param) {
+    }
+
+private:
+    M** const impls_;
+    M** const* const impls_end_;
+    const int param_;
+
+    void build(arg_desc& desc, void* base) const final {
+        const char* top = static_cast<const char*>(base) - desc.base_offset_;
+
+        for(M** m = impls_ ; m != *impls_end_ ; ++m) {
+            const auto i = m - impls_;
+            const auto r = static_cast<const char*>((*m)->casts_[param_](base));
+            desc.accepts_ |= r ? std::uint64_t(1) << i : 0;
+            desc.offsets_[i] = r ? r - top : arg_desc::no_cast;
+        }
+    }
+};
+
+/**********************************************************************************************/
+template<std::size_t N, class T = void, class... Args>
+struct nth_type {
+    using type = typename nth_type<N - 1, Args...>::type;
+};
+
+/**********************************************************************************************/
+template<class T, class... Args>
+struct nth_type<0, T, Args...> {
+    using type = T;
+};
+
+/**********************************************************************************************/
+// Classes of a closed hierarchy, declared with MM_SEALED.
+//
+template<class... T>
+struct sealed_types final {
+    static constexpr int size = sizeof...(T);
+
+    template<std::size_t I>
+    using at = typename nth_type<I, T...>::type;
+};
+
+/**********************************************************************************************/
+// Concrete classes of a sealed hierarchy that may be dynamic types of arguments for 'B'.
+//
+template<class B, class... T>
+auto sealed_filter(sealed_types<T...>) {
+    return std::tuple_cat(conditional_t<(is_same_v<B, T> || is_base_of_v<B, T>) && !std::is_abstract_v<T>,
+        std::tuple<T>, std::tuple<>>()...);
+}
+
+template<class B, class = void>
+struct sealed_classes {
+    using type = sealed_types<>;
+};
+
+template<class... T>
+sealed_types<T...> sealed_from_tuple(std::tuple<T...>);
+
+template<class B>
+struct sealed_classes<B, std::void_t<decltype(mm_sealed(static_cast<const B*>(nullptr)))>> {
+    using type = decltype(sealed_from_tuple(sealed_filter<B>(decltype(mm_sealed(static_cast<const B*>(nullptr)))())));
+};
+
+/**********************************************************************************************/
+// Classes without virtual functions, whose dynamic types are found by tags: 'mm_type_id(const B&)'
+// (found by ADL) returns the tag of an object, all classes of the hierarchy are declared with
+// MM_SEALED and each of them declares its own tag with MM_TYPE_ID.
+//
+template<class T, class = void>
+struct has_type_id : std::false_type {};
+
+template<class T>
+struct has_type_id<T, std::void_t<decltype(mm_type_id(std::declval<const T&>()))>> : std::true_type {};
+
+template<class T>
+constexpr bool tagged_class() {
+    if constexpr(std::is_class_v<T> && !is_polymorphic_v<T> && has_type_id<T>::value) {
+        return sealed_classes<T>::type::size > 0;
+    } else {
+        return false;
+    }
+}
+
+/**********************************************************************************************/
+// Class has a dynamic type: polymorphic or tagged.
+//
+template<class T>
+constexpr bool dynamic_class() {
+    return is_polymorphic_v<T> || tagged_class<T>();
+}
+
+/**********************************************************************************************/
+// Pointers to polymorphic objects: raw pointers, 'std::shared_ptr' and 'std::unique_ptr'.
+// Arguments are dispatched by dynamic types of pointees, null pointers have type
+// 'std::nullptr_t'.
+//
+template<class T>
+struct poly_pointer_traits {
+    static constexpr bool value = false;
+};
+
+template<class T>
+struct poly_pointer_traits<T*> {
+    static constexpr bool value = is_polymorphic_v<T>;
+    using element_type = T;
+};
+
+template<class T>
+struct poly_pointer_traits<std::shared_ptr<T>> {
+    static constexpr bool value = is_polymorphic_v<T>;
+    using element_type = T;
+};
+
+template<class T, class D>
+struct poly_pointer_traits<std::unique_ptr<T, D>> {
+    static constexpr bool value = is_polymorphic_v<T>;
+    using element_type = T;
+};
+
+/**********************************************************************************************/
+template<class T>
+constexpr bool poly_pointer() {
+    return poly_pointer_traits<decay_t<T>>::value;
+}
+
+/**********************************************************************************************/
+template<class T>
+using pointee_t = typename poly_pointer_traits<decay_t<T>>::element_type;
+
+/**********************************************************************************************/
+template<class P>
+auto pointee_address(P& p) {
+    if constexpr(std::is_pointer_v<decay_t<P>>) {
+        return p;
+    } else {
+        return p.get();
+    }
+}
+
+/**********************************************************************************************/
+// Class of a parameter to compare implementations: pointee's class for pointers.
+//
+template<class T, bool = poly_pointer<T>()>
+struct param_class {
+    using type = decay_t<T>;
+};
+
+template<class T>
+struct param_class<T, true> {
+    using type = decay_t<pointee_t<T>>;
+};
+
+template<class T>
+using param_class_t = typename param_class<T>::type;
+
+/**********************************************************************************************/
+// 'std::any' parameter, dispatched by the type of its value.
+//
+template<class T>
+constexpr bool any_param() {
+    return is_same_v<decay_t<T>, std::any>;
+}
+
+/**********************************************************************************************/
+static inline std::nullptr_t g_null_argument; // Target of casts of null pointers to 'std::nullptr_t'.
+
+/**********************************************************************************************/
+// Tag of a class, declared with MM_TYPE_ID. Classes without tags (like a base class, that only
+// reads tags) are never found by tags.
+//
+template<class C, class = void>
+struct class_tag {
+    static constexpr bool known = false;
+    static constexpr long long value = 0;
+};
+
+template<class C>
+struct class_tag<C, std::void_t<decltype(C::mm_type_id_value)>> {
+    static constexpr bool known = true;
+    static constexpr long long value = static_cast<long long>(C::mm_type_id_value);
+};
+
+/**********************************************************************************************/
+template<class... C>
+constexpr bool unique_tags(sealed_types<C...>) {
+    constexpr bool known[] = { false, class_tag<C>::known... };
+    constexpr long long tags[] = { 0, class_tag<C>::value... };
+    for(std::size_t i = 1 ; i <= sizeof...(C) ; ++i) {
+        for(std::size_t j = i + 1 ; j <= sizeof...(C) ; ++j) {
+            if(known[i] && known[j] && tags[i] == tags[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**********************************************************************************************/
+// Indexes of classes by tags, for hierarchies whose tags are close to each other. Tags of large
+// hierarchies (that are dispatched by the cache instead of a switch) are found by one load.
+//
+template<class... C>
+struct tag_table {
+    static constexpr long long tags[] = { class_tag<C>::value... };
+    static constexpr bool known[] = { class_tag<C>::known... };
+
+    static constexpr long long bound(bool high) {
+        long long r = 0;
+        bool found = false;
+        for(std::size_t i = 0 ; i < sizeof...(C) ; ++i) {
+            if(known[i] && (!found || (high ? tags[i] > r : tags[i] < r))) {
+                r = tags[i];
+                found = true;
+            }
+        }
+        return r;
+    }
+
+    static constexpr long long low = bound(false);
+    static constexpr long long size = bound(true) - low + 1;
+    static constexpr bool dense = sizeof...(C) > 8 && size > 0 && size <= 1024;
+
+    struct indexes_t { short v[dense ? size : 1]; };
+
+    static constexpr indexes_t make() {
+        indexes_t r {};
+        for(short& i : r.v) {
+            i = -1;
+        }
+        for(std::size_t i = 0 ; dense && i < sizeof...(C) ; ++i) {
+            if(known[i]) {
+                r.v[tags[i] - low] = short(i);
+            }
+        }
+        return r;
+    }
+    static constexpr indexes_t indexes = make();
+
+    template<class I>
+    static int find(I id) {
+        const long long k = static_cast<long long>(id) - low;
+        return k >= 0 && k < size ? indexes.v[k] : -1;
+    }
+};
+
+/**********************************************************************************************/
+// Index of a class with the tag in a hierarchy or -1.
+//
+template<class... C, class I>
+int tagged_index(sealed_types<C...> classes, I id) {
+    static_assert(unique_tags(classes), "Each class of a tagged hierarchy needs its own MM_TYPE_ID.");
+
+    if constexpr(tag_table<C...>::dense) {
+        return tag_table<C...>::find(id);
+    } else {
+        int r = -1;
+        int i = 0;
+        ((class_tag<C>::known && id == class_tag<C>::value ? (r = i, true) : (++i, false)) || ...);
+        return r;
+    }
+}
+
+/**********************************************************************************************/
+// Type of a class with the tag, 'B' for unknown tags.
+//
+template<class B, class... C, class I>
+const std::type_info* tagged_type(sealed_types<C...> classes, I id) {
+    if constexpr(tag_table<C...>::dense) {
+        static const std::type_info* const types[] = { &typeid(C)... };
+        const int i = tagged_index(classes, id);
+        return i >= 0 ? types[i] : &typeid(B);
+    } else {
+        const std::type_info* r = &typeid(B);
+        ((class_tag<C>::known && id == class_tag<C>::value ? (r = &typeid(C), true) : false) || ...);
+        return r;
+    }
+}
+
+/**********************************************************************************************/
+// An object of a class with the tag can be passed as 'T'.
+//
+template<class T, class... C, class I>
+bool tagged_accepts(sealed_types<C...> classes, I id) {
+    if constexpr(tag_table<C...>::dense) {
+        static constexpr bool accepts[] = { (is_same_v<T, C> || is_base_of_v<T, C>)... };
+        const int i = tagged_index(classes, id);
+        return i >= 0 && accepts[i];
+    } else {
+        return (... || ((is_same_v<T, C> || is_base_of_v<T, C>) && class_tag<C>::known && id == class_tag<C>::value));
+    }
+}
+
+/**********************************************************************************************/
+// Casts an argument to a parameter's type of an implementation, to build descriptors.
+//
+template<class B, class T>
+void* cast_parameter(void* base) {
+    using BD = decay_t<B>;
+    using TD = decay_t<T>;
+
+    if constexpr(any_param<BD>()) {
+        if constexpr(is_same_v<TD, std::any>) {
+            return base;
+        } else {
+            return const_cast<TD*>(std::any_cast<TD>(static_cast<std::any*>(base)));
+        }
+    } else if constexpr(poly_pointer<BD>()) {
+        // 'base' is the pointee
+        if constexpr(is_same_v<TD, std::nullptr_t>) {
+            return base ? nullptr : &g_null_argument;
+        } else if constexpr(is_same_v<TD, BD>) {
+            return base ? base : &g_null_argument;
+        } else {
+            return base ? cast_parameter<pointee_t<BD>, T>(base) : nullptr;
+        }
+    } else if constexpr(is_polymorphic_v<BD> && is_polymorphic_v<TD> && !is_same_v<BD, TD>) {
+        return dynamic_cast<TD*>(static_cast<BD*>(base));
+    } else if constexpr(tagged_class<BD>() && is_base_of_v<BD, TD> && !is_same_v<BD, TD>) {
+        BD* b = static_cast<BD*>(base);
+        return tagged_accepts<TD>(typename sealed_classes<BD>::type(), mm_type_id(*b)) ? static_cast<TD*>(b) : nullptr;
+    } else {
+        return base;
+    }
+}
+
+
+/**********************************************************************************************/
+// An argument for polymorphic type.
+//
+template<class B>
+struct arg_poly {
+    B* const base_ { nullptr };
+    const std::type_info* const type_ { nullptr }; // Dynamic type, if the parameter is dispatched.
+    const char* const top_ { nullptr };            // Address of the most-derived object, if dispatched.
+    mutable const arg_desc* desc_ { nullptr };     // Casts for all implementations, if resolved.
+    constexpr arg_poly() = default;
+
+    constexpr explicit arg_poly(B& v)
+    : base_(&v) {
+    }
+
+    // Dynamic type of a dispatched argument is found once per call.
+    arg_poly(B& v, bool dispatched)
+    : base_(&v),
+      type_(dispatched ? &typeid(v) : nullptr),
+      top_(dispatched ? static_cast<const char*>(dynamic_cast<const void*>(&v)) : nullptr) {
+    }
+
+    // Dynamic type and the most-derived object are already known, for dispatch contexts.
+    arg_poly(B& v, const std::type_info* type, const char* top)
+    : base_(&v),
+      type_(type),
+      top_(top) {
+    }
+
+    // Dynamic type is already resolved, for arguments grouped by types.
+    arg_poly(B& v, const arg_desc* desc)
+    : base_(&v),
+      type_(desc->type_),
+      top_(reinterpret_cast<const char*>(&v) - desc->base_offset_),
+      desc_(desc) {
+    }
+
+    // Pointee of a pointer argument, 'v' may be null (see 'arg_pointer').
+    explicit arg_poly(B* v)
+    : base_(v) {
+    }
+
+    arg_poly(B* v, bool dispatched)
+    : base_(v),
+      type_(dispatched ? (v ? &typeid(*v) : &typeid(std::nullptr_t)) : nullptr),
+      top_(dispatched && v ? static_cast<const char*>(dynamic_cast<const void*>(v)) : nullptr) {
+    }
+
+    arg_poly(B* v, const std::type_info* type, const char* top)
+    : base_(v),
+      type_(type),
+      top_(top) {
+    }
+
+    arg_poly(B* v, const arg_desc* desc)
+    : base_(v),
+      type_(desc->type_),
+      top_(v ? reinterpret_cast<const char*>(v) - desc->base_offset_ : nullptr),
+      desc_(desc) {
+    }
+
+    // Dynamic type of the argument.
+    const std::type_info* type() const { return type_ ? type_ : &typeid(*base_); }
+
+    // Finds descriptor of the argument's type, so implementations just check it instead of casts.
+    // Returns bit mask of implementations that accept the argument, by positions.
+    std::uint64_t resolve(arg_descs_base& descs) const {
+        if(!desc_ && type_) {
+            desc_ = descs.get(const_cast<void*>(static_cast<const void*>(base_)), type_, reinterpret_cast<const char*>(base_) - top_);
+        }
+        return desc_ ? desc_->accepts_ : ~std::uint64_t(0);
+    }
+
+    template<class T>
+    constexpr enable_if_t<is_same_v<decay_t<T>, decay_t<B>>, B*> cast(int /*position*/) const {
+        return base_;
+    }
+
+    template<class T, class TD = remove_reference_t<T>>
+    constexpr enable_if_t<!is_same_v<decay_t<T>, decay_t<B>>, TD*> cast(int position) const {
+        TD* r;
+
+        // Fallback
+        if constexpr(is_same_v<decay_t<T>, fallback_t>) {
+            r = &g_dummy_fallback;
+        }
+        // Class with MM_CLASS macro
+        else if constexpr(has_class_info<decay_t<T>>::value) {
+            r = reinterpret_cast<TD*>(base_->mm_cast(decay_t<T>::mm_class_id));
+        }
+        // Resolved by a dispatcher
+        else if(desc_) {
+            const std::ptrdiff_t offset = desc_->offsets_[position];
+            r = offset == arg_desc::no_cast ? nullptr : reinterpret_cast<TD*>(const_cast<char*>(top_) + offset);
+        }
+        // Class without MM_CLASS macro
+        else {
+            r = cast_cache<B, TD>::cast(base_, type_, top_);
+        }
+
+        return r;
+    }
+};
+
+/**********************************************************************************************/
+// An argument for a class without virtual functions, whose dynamic type is found by a tag.
+//
+template<class B>
+struct arg_tagged {
+    using classes_t = typename sealed_classes<decay_t<B>>::type;
+    static_assert(unique_tags(classes_t()), "Each class of a tagged hierarchy needs its own MM_TYPE_ID.");
+
+    B* const base_ { nullptr };
+    const std::type_info* const type_ { nullptr }; // Class with the tag, if the parameter is dispatched.
+    mutable const arg_desc* desc_ { nullptr };     // Casts for all implementations, if resolved.
+    constexpr arg_tagged() = default;
+
+    constexpr explicit arg_tagged(B& v)
+    : base_(&v) {
+    }
+
+    // Tag of a dispatched argument is read once per call.
+    arg_tagged(B& v, bool dispatched)
+    : base_(&v),
+      type_(dispatched ? tagged_type<decay_t<B>>(classes_t(), mm_type_id(v)) : nullptr) {
+    }
+
+    // Class with the tag is already known, for dispatch contexts.
+    arg_tagged(B& v, const std::type_info* type, const char* /*top*/)
+    : base_(&v),
+      type_(type) {
+    }
+
+    // Dynamic type is already resolved, for arguments grouped by types.
+    arg_tagged(B& v, const arg_desc* desc)
+    : base_(&v),
+      type_(desc->type_),
+      desc_(desc) {
+    }
+
+    // Class with the argument's tag, or 'B' for unknown tags.
+    const std::type_info* type() const { return type_ ? type_ : tagged_type<decay_t<B>>(classes_t(), mm_type_id(*base_)); }
+
+    // Finds descriptor of the argument's class, tagged classes don't have virtual bases.
+    std::uint64_t resolve(arg_descs_base& descs) const {
+        if(!desc_ && type_) {
+            desc_ = descs.get(const_cast<void*>(static_cast<const void*>(base_)), type_, 0);
+        }
+        return desc_ ? desc_->accepts_ : ~std::uint64_t(0);
+    }
+
+    template<class T>
+    constexpr enable_if_t<is_same_v<decay_t<T>, decay_t<B>>, B*> cast(int /*position*/) const {
+        return base_;
+    }
+
+    template<class T, class TD = remove_reference_t<T>>
+    constexpr enable_if_t<!is_same_v<decay_t<T>, decay_t<B>>, TD*> cast(int position) const {
+        TD* r;
+
+        // Fallback
+        if constexpr(is_same_v<decay_t<T>, fallback_t>) {
+            r = &g_dummy_fallback;
+        }
+        // Resolved by a dispatcher
+        else if(desc_) {
+            r = desc_->offsets_[position] == arg_desc::no_cast ? nullptr : static_cast<TD*>(base_);
+        }
+        // Checks the tag
+        else {
+            r = tagged_accepts<decay_t<T>>(classes_t(), mm_type_id(*base_)) ? static_cast<TD*>(base_) : nullptr;
+        }
+
+        return r;
+    }
+};
+
+/**********************************************************************************************/
+// An argument for non-polymorphic type.
+//
+template<class B>
+struct arg_non_poly {
+    B* const p_ { nullptr };
+    constexpr arg_non_poly() = default;
+
+    constexpr explicit arg_non_poly(B& v)
+    : p_(&v) {
+    }
+
+    constexpr arg_non_poly(B& v, bool /*dispatched*/)
+    : p_(&v) {
+    }
+
+    constexpr arg_non_poly(B& v, const std::type_info* /*type*/, const char* /*top*/)
+    : p_(&v) {
+    }
+
+    constexpr std::uint64_t resolve(arg_descs_base& /*descs*/) const { return ~std::uint64_t(0); }
+
+    const std::type_info* type() const { return &typeid(B); }
+
+    template<class T>
+    constexpr auto cast(int /*position*/) const {
+        remove_reference_t<T>* r;
+
+        // Fallback
+        if constexpr(is_same_v<decay_t<T>, fallback_t>) {
+            r = &g_dummy_fallback;
+        }
+        // Value
+        else {
+            r = p_;
+        }
+
+        return r;
+    }
+};
+
+/**********************************************************************************************/
+// An argument for a pointer to a polymorphic type, dispatched by the pointee. Implementations
+// get the pointee by reference, 'std::nullptr_t' for null pointers, or the pointer itself.
+// The pointer is never copied, so smart pointers cost no reference counting.
+//
+template<class P>
+struct arg_pointer : arg_poly<pointee_t<P>> {
+    using base_t = arg_poly<pointee_t<P>>;
+
+    P* const ptr_ { nullptr };
+    constexpr arg_pointer() = default;
+
+    explicit arg_pointer(P& p)
+    : base_t(pointee_address(p)),
+      ptr_(&p) {
+    }
+
+    arg_pointer(P& p, bool dispatched)
+    : base_t(pointee_address(p), dispatched),
+      ptr_(&p) {
+    }
+
+    arg_pointer(P& p, const std::type_info* type, const char* top)
+    : base_t(pointee_address(p), type, top),
+      ptr_(&p) {
+    }
+
+    arg_pointer(P& p, const arg_desc* desc)
+    : base_t(pointee_address(p), desc),
+      ptr_(&p) {
+    }
+
+    const std::type_info* type() const { return this->base_ ? base_t::type() : &typeid(std::nullptr_t); }
+
+    template<class T>
+    auto cast(int position) const {
+        using TD = decay_t<T>;
+
+        // Fallback
+        if constexpr(is_same_v<TD, fallback_t>) {
+            return base_t::template cast<T>(position);
+        }
+        // The pointer itself
+        else if constexpr(is_same_v<TD, decay_t<P>>) {
+            return ptr_;
+        }
+        // Null pointer
+        else if constexpr(is_same_v<TD, std::nullptr_t>) {
+            return this->base_ ? nullptr : &g_null_argument;
+        }
+        // Pointee
+        else {
+            return this->base_ ? base_t::template cast<T>(position) : nullptr;
+        }
+    }
+};
+
+/**********************************************************************************************/
+// An argument for 'std::any', dispatched by the exact type of its value ('void' if it's
+// empty). Implementations get the value by reference or the 'std::any' itself.
+//
+template<class B>
+struct arg_any {
+    B* const p_ { nullptr };
+    const std::type_info* const type_ { nullptr }; // Type of the value, if the parameter is dispatched.
+    mutable const arg_desc* desc_ { nullptr };     // Implementations that accept the type, if resolved.
+    constexpr arg_any() = default;
+
+    constexpr explicit arg_any(B& v)
+    : p_(&v) {
+    }
+
+    arg_any(B& v, bool dispatched)
+    : p_(&v),
+      type_(dispatched ? &v.type() : nullptr) {
+    }
+
+    arg_any(B& v, const std::type_info* type, const char* /*top*/)
+    : p_(&v),
+      type_(type) {
+    }
+
+    // Implementations that accept the value's type, by positions.
+    std::uint64_t resolve(arg_descs_base& descs) const {
+        if(!desc_ && type_) {
+            desc_ = descs.get(const_cast<std::any*>(p_), type_, 0);
+        }
+        return desc_ ? desc_->accepts_ : ~std::uint64_t(0);
+    }
+
+    const std::type_info* type() const { return type_ ? type_ : &p_->type(); }
+
+    template<class T>
+    auto cast(int /*position*/) const {
+        using TD = remove_reference_t<T>;
+
+        // Fallback
+        if constexpr(is_same_v<decay_t<T>, fallback_t>) {
+            return &g_dummy_fallback;
+        }
+        // The 'std::any' itself
+        else if constexpr(is_same_v<decay_t<T>, std::any>) {
+            return p_;
+        }
+        // Value
+        else {
+            return std::any_cast<TD>(p_);
+        }
+    }
+};
+
+/**********************************************************************************************/
+// Dummy void argument.
+//
+struct arg_void {
+    template<class T>
+    constexpr remove_reference_t<T>* cast(int /*position*/) const { return nullptr; }
+
+    const std::type_info* type() const { return nullptr; }
+};
+
+/**********************************************************************************************/
+// An argument for a method's implementation.
+//
+template<
+    class B,
+    class U = remove_reference_t<B>,
+    class S = conditional_t<is_same_v<B, void>,
+                  arg_void,
+                  conditional_t<is_polymorphic_v<decay_t<U>>, arg_poly<U>,
+                      conditional_t<tagged_class<decay_t<U>>(), arg_tagged<U>,
+                          conditional_t<poly_pointer<U>(), arg_pointer<U>,
+                              conditional_t<any_param<U>(), arg_any<U>, arg_non_poly<U>>>>>>
+>
+struct arg final : S {
+    constexpr explicit arg(fallback_t /*dummy*/) {}
+    constexpr explicit arg(B& v) : S(v) {}
+    constexpr arg(B& v, bool dispatched) : S(v, dispatched) {}
+    arg(B& v, const std::type_info* type, const char* top) : S(v, type, top) {}
+    arg(B& v, const arg_desc* desc) : S(v, desc) {}
+};
+
+
+/**********************************************************************************************/
+// Exception to skip an implementation and try next one.
+//
+struct try_next final : std::exception {
+#ifdef MM_ENABLE_PROFILE
+    try_next() { profile_skipped() = timestamp(); }
+#endif
+
+    const char* what() const noexcept final { return "next_method"; }
+};
+
+
+/**********************************************************************************************/
+// Helper class to wrap a reference.
+//
+template<class U>
+struct optional_ref {
+    optional_ref() : p_(nullptr) {}
+    explicit optional_ref(U v) : p_(&v) {}
+
+    explicit operator bool() const { return p_; }
+    U operator *() const { return static_cast<U>(*p_); }
+
+    remove_reference_t<U>* p_;
+};
+
+/**********************************************************************************************/
+template<class T, class B = conditional_t<
+    is_reference_v<T>,
+    optional_ref<T>,
+    optional<remove_reference_t<T>>>
+>
+struct method_ret_type final : B {
+    method_ret_type() = default;
+    explicit method_ret_type(T&& v) : B(std::forward<T>(v)) {}
+};
+
+
+/**********************************************************************************************/
+// Virtual calls of implementations: with arguments of a method ('N' of them) and with one
+// argument for the fallback. Calls of other arities aren't declared, so they don't take slots
+// in vtables of all implementations.
+//
+template<int N, class R, class B1, class B2, class B3, class B4, class B5, class B6>
+struct method_calls {
+    virtual R call(const arg<B1>& /*p1*/) { return {}; }
+};
+
+template<class R, class B1, class B2, class B3, class B4, class B5, class B6>
+struct method_calls<0, R, B1, B2, B3, B4, B5, B6> {
+    virtual R call() { return {}; }
+    virtual R call(const arg<B1>& /*p1*/) { return {}; }
+};
+
+template<class R, class B1, class B2, class B3, class B4, class B5, class B6>
+struct method_calls<2, R, B1, B2, B3, B4, B5, B6> {
+    virtual R call(const arg<B1>& /*p1*/) { return {}; }
+    virtual R call(const arg<B1>& /*p1*/, const arg<B2>& /*p2*/) { return {}; }
+};
+
+template<class R, class B1, class B2, class B3, class B4, class B5, class B6>
+struct method_calls<3, R, B1, B2, B3, B4, B5, B6> {
+    virtual R call(const arg<B1>& /*p1*/) { return {}; }
+    virtual R call(const arg<B1>& /*p1*/, const arg<B2>& /*p2*/, const arg<B3>& /*p3*/) { return {}; }
+};
+
+template<class R, class B1, class B2, class B3, class B4, class B5, class B6>
+struct method_calls<4, R, B1, B2, B3, B4, B5, B6> {
+    virtual R call(const arg<B1>& /*p1*/) { return {}; }
+    virtual R call(const arg<B1>& /*p1*/, const arg<B2>& /*p2*/, const arg<B3>& /*p3*/, const arg<B4>& /*p4*/) { return {}; }
+};
+
+template<class R, class B1, class B2, class B3, class B4, class B5, class B6>
+struct method_calls<5, R, B1, B2, B3, B4, B5, B6> {
+    virtual R call(const arg<B1>& /*p1*/) { return {}; }
+    virtual R call(const arg<B1>& /*p1*/, const arg<B2>& /*p2*/, const arg<B3>& /*p3*/, const arg<B4>& /*p4*/, const arg<B5>& /*p5*/) { return {}; }
+};
+
+template<class R, class B1, class B2, class B3, class B4, class B5, class B6>
+struct method_calls<6, R, B1, B2, B3, B4, B5, B6> {
+    virtual R call(const arg<B1>& /*p1*/) { return {}; }
+    virtual R call(const arg<B1>& /*p1*/, const arg<B2>& /*p2*/, const arg<B3>& /*p3*/, const arg<B4>& /*p4*/, const arg<B5>& /*p5*/, const arg<B6>& /*p6*/) { return {}; }
+};
+
+/**********************************************************************************************/
+// Type, that depends on 'N', so bodies of templates that use it aren't checked until they are
+// instantiated.
+//
+template<int N, class T>
+struct dependent_type {
+    using type = T;
+};
+
+/**********************************************************************************************/
+template<class... B>
+constexpr int count_params() {
+    return (0 + ... + int(!is_same_v<B, none_t>));
+}
+
+/**********************************************************************************************/
+// Base class for methods' implementations.
+//
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6>
+struct abstract_method : method_calls<count_params<B1, B2, B3, B4, B5, B6>(),
+    conditional_t<is_same_v<T, void>, bool, method_ret_type<T>>, B1, B2, B3, B4, B5, B6> {
+    using ret_t = conditional_t<is_same_v<T, void>, bool, method_ret_type<T>>;
+
+    bool is_fallback() const { return fallback_; }
+
+    bool fallback_ { false };                      // Handler of calls without implementations.
+    const std::type_info* signature_ { nullptr };  // Type of the implementation's function.
+    const std::type_info* types_[6] {};            // Types of parameters.
+    int source_ { -1 };                            // Index in a definition of a method.
+    int index_ { -1 };                             // Index of registration.
+    int position_ { -1 };                          // Index in order of dispatching.
+    void* (*casts_[6])(void*) {};                  // Casts from base types to parameters' types.
+    T (*direct_)(void* const*) {};                 // Calls the function with arguments already cast.
+};
+
+/**********************************************************************************************/
+// Data of a multimethod for algorithms that get it as a function object.
+//
+template<class M>
+struct method_data final {
+    M** const impls_;
+    M** const& impls_end_;
+    M* const& fallback_;
+    arg_descs<M>* const descs_;
+    method_info& info_;
+    const char* const name_;
+};
+
+/**********************************************************************************************/
+// Registers implementations of a method (in order of dispatching) and builds its exact table,
+// out of line for all methods with the same types of parameters.
+//
+template<class M, class C>
+MM_NOINLINE void register_impls(M* const* methods, int count, M** impls, M**& impls_end, M*& handler,
+                                method_info& info, C& cache, unsigned mask, bool (*covers)(int, int),
+                                decltype(M::direct_) const* directs) {
+    for(int i = 0 ; i < count ; ++i) {
+        M* it = methods[i];
+
+        if(!it) {
+            continue; // Qualified implementation
+        } else if(it->is_fallback()) {
+            handler = it;
+        } else {
+            it->direct_ = directs[it->source_];
+            it->index_ = it->position_ = static_cast<int>(impls_end - impls);
+            *impls_end++ = it;
+            info.add_impl(it->signature_, it->types_, it->source_);
+        }
+    }
+
+    cache.build_exact(impls, impls_end, mask, covers);
+}
+
+/**********************************************************************************************/
+// Changes order of dispatching of a method (see 'method_info::reorder_').
+//
+template<class M, class C>
+MM_NOINLINE void reorder_method(const std::vector<int>& order, M** impls, M** impls_end, C& cache,
+                                arg_descs<M>* descs, unsigned mask, bool (*covers)(int, int)) {
+    reorder_impls(impls, order);
+    cache.build_exact(impls, impls_end, mask, covers);
+    for(int i = 0 ; i < 6 ; ++i) {
+        descs[i].clear();
+    }
+}
+
+
+/**********************************************************************************************/
+// Parameter of a prototype, that implementations may take by value, rvalue reference or const
+// reference, so large values are moved or not copied at all.
+//
+template<class T>
+constexpr bool movable_param() {
+    return !std::is_lvalue_reference_v<T> && !is_const_v<remove_reference_t<T>> &&
+           !poly_pointer<decay_t<T>>() && !any_param<decay_t<T>>() && !is_same_v<decay_t<T>, none_t>;
+}
+
+/**********************************************************************************************/
+template<class... Args> constexpr enable_if_t<sizeof...(Args) == 0, bool> check_types() { return false; }
+template<class T1> constexpr bool check_types() { return false; }
+template<class T1, class T2, class T3> constexpr bool check_types() { return false; }
+template<class T1, class T2, class T3, class T4, class T5> constexpr bool check_types() { return false; }
+template<class T1, class T2, class T3, class T4, class T5, class T6, class T7> constexpr bool check_types() { return false; }
+template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9> constexpr bool check_types() { return false; }
+template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11> constexpr bool check_types() { return false; }
+
+/**********************************************************************************************/
+template<class T, class U>
+constexpr bool check_types() {
+    // 'std::any': the value by reference or the 'std::any' itself
+    if constexpr(any_param<T>()) {
+        if constexpr(any_param<U>()) {
+            static_assert(is_same_v<T, U> || is_same_v<U, const std::any&>, "Implementation takes 'std::any' as the prototype or by const reference.");
+        } else {
+            static_assert(is_reference_v<U> && is_reference_v<T>, "Need to use references to take values of 'std::any'.");
+            static_assert(is_const_v<remove_reference_t<T>> == is_const_v<remove_reference_t<U>>, "Implementation cannot add/remove const to a value of 'std::any'.");
+        }
+    }
+    // Pointer: the pointee by reference, 'std::nullptr_t' or the pointer itself
+    else if constexpr(poly_pointer<T>() && !is_same_v<decay_t<U>, std::nullptr_t>) {
+        using E = pointee_t<T>;
+
+        if constexpr(is_same_v<decay_t<T>, decay_t<U>>) {
+            static_assert(is_same_v<T, U> || is_same_v<U, const decay_t<T>&>, "Implementation takes a pointer as the prototype or by const reference.");
+        } else {
+            static_assert(is_reference_v<U>, "Need to use reference to specify a pointee's type.");
+            static_assert(is_const_v<E> == is_const_v<remove_reference_t<U>>, "Implementation cannot add/remove const to a pointee's type.");
+            static_assert(is_same_v<decay_t<E>, decay_t<U>> || is_base_of_v<decay_t<E>, decay_t<U>>, "Implementation can specify pointee's type, but not replace it.");
+        }
+    }
+    // Value or rvalue reference: by value, by rvalue reference or by const reference. Rvalue
+    // references are not taken by value: the argument would be moved out before 'next_method'.
+    else if constexpr(movable_param<T>() && is_same_v<decay_t<T>, decay_t<U>> &&
+                      (is_same_v<U, decay_t<T>> || is_same_v<U, decay_t<T>&&> || is_same_v<U, const decay_t<T>&>)) {
+        static_assert(is_reference_v<U> || !is_reference_v<T>, "Implementation takes an rvalue reference by rvalue or const reference, not by value.");
+    } else if constexpr(!poly_pointer<T>() && !any_param<T>()) {
+        static_assert(is_reference_v<T> == is_reference_v<U>, "Implementation cannot add/remove reference to a parameter's type.");
+        static_assert(is_const_v<remove_reference_t<T>> == is_const_v<remove_reference_t<U>>, "Implementation cannot add/remove const to a parameter's type.");
+
+        if constexpr(!is_same_v<decay_t<T>, decay_t<U>>) {
+            static_assert(is_reference_v<T>, "Need to use reference to specify a parameter's type.");
+            static_assert(dynamic_class<decay_t<T>>() && is_base_of_v<decay_t<T>, decay_t<U>>, "Implementation can specify parameter's type, but not replace it.");
+        }
+    }
+
+    return true;
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class U1, class U2>
+constexpr bool check_types() {
+    return check_types<T1, U1>() &&
+           check_types<T2, U2>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class U1, class U2, class U3>
+constexpr bool check_types() {
+    return check_types<T1, U1>() &&
+           check_types<T2, T3, U2, U3>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class T4, class U1, class U2, class U3, class U4>
+constexpr bool check_types() {
+    return check_types<T1, U1>() &&
+           check_types<T2, T3, T4, U2, U3, U4>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class T4, class T5, class U1, class U2, class U3, class U4, class U5>
+constexpr bool check_types() {
+    return check_types<T1, U1>() &&
+           check_types<T2, T3, T4, T5, U2, U3, U4, U5>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class T4, class T5, class T6, class U1, class U2, class U3, class U4, class U5, class U6>
+constexpr bool check_types() {
+    return check_types<T1, U1>() &&
+           check_types<T2, T3, T4, T5, T6, U2, U3, U4, U5, U6>();
+}
+
+/**********************************************************************************************/
+template<class F1, class F2>
+struct check_parameters_impl;
+
+/**********************************************************************************************/
+template<class R, class... Args1, class... Args2>
+struct check_parameters_impl<R(*)(Args1...), R(*)(Args2...)> {
+    static constexpr bool value = check_types<Args1..., Args2...>();
+};
+
+/**********************************************************************************************/
+template<class R, class... Args>
+struct check_parameters_impl<R(*)(Args...), R(*)(fallback_t)> {
+    static constexpr bool value = true;
+};
+
+/**********************************************************************************************/
+template<class F1, class F2>
+struct check_parameters final : public check_parameters_impl<F1, signature_t<F2>> {
+};
+
+/**********************************************************************************************/
+// Before and after implementations return nothing.
+//
+template<class R, class... Args1, class Q, class... Args2>
+struct check_parameters<R(*)(Args1...), qualified<Q, void(*)(Args2...)>> final {
+    static constexpr bool value = check_types<Args1..., Args2...>();
+};
+
+
+/**********************************************************************************************/
+template<class... Args> constexpr enable_if_t<sizeof...(Args) == 0, int> compare_types() { return 0; }
+template<class> constexpr int compare_types() { return 0; }
+template<class, class, class> constexpr int compare_types() { return 0; }
+template<class, class, class, class, class> constexpr int compare_types() { return 0; }
+template<class, class, class, class, class, class, class> constexpr int compare_types() { return 0; }
+template<class, class, class, class, class, class, class, class, class> constexpr int compare_types() { return 0; }
+template<class, class, class, class, class, class, class, class, class, class, class> constexpr int compare_types() { return 0; }
+
+/**********************************************************************************************/
+template<class T, class U>
+constexpr int compare_types() {
+    using TD = decay_t<T>;
+    using UD = decay_t<U>;
+
+    // The same types - just check constness
+    if constexpr(is_same_v<TD, UD>) {
+        return 0;
+    }
+
+    // Prefer values to 'std::any'
+    if constexpr(any_param<TD>()) {
+        return 1;
+    }
+    if constexpr(any_param<UD>()) {
+        return -1;
+    }
+
+    // Prefer null pointers to pointers
+    if constexpr(poly_pointer<TD>() && is_same_v<UD, std::nullptr_t>) {
+        return 1;
+    }
+    if constexpr(poly_pointer<UD>() && is_same_v<TD, std::nullptr_t>) {
+        return -1;
+    }
+
+    // Prefer derived classes, and pointees to pointers
+    if constexpr(is_base_of_v<param_class_t<T>, param_class_t<U>> && (poly_pointer<TD>() || !is_same_v<param_class_t<T>, param_class_t<U>>)) {
+        return 1;
+    }
+    if constexpr(is_base_of_v<param_class_t<U>, param_class_t<T>> && (poly_pointer<UD>() || !is_same_v<param_class_t<T>, param_class_t<U>>)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class U1, class U2>
+constexpr int compare_types() {
+    if(constexpr int r = compare_types<T1, U1>() ) {
+        return r;
+    }
+    return compare_types<T2, U2>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class U1, class U2, class U3>
+constexpr int compare_types() {
+    if(constexpr int r = compare_types<T1, U1>() ) {
+        return r;
+    }
+    return compare_types<T2, T3, U2, U3>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class T4, class U1, class U2, class U3, class U4>
+constexpr int compare_types() {
+    if(constexpr int r = compare_types<T1, U1>() ) {
+        return r;
+    }
+    return compare_types<T2, T3, T4, U2, U3, U4>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class T4, class T5, class U1, class U2, class U3, class U4, class U5>
+constexpr int compare_types() {
+    if(constexpr int r = compare_types<T1, U1>() ) {
+        return r;
+    }
+    return compare_types<T2, T3, T4, T5, U2, U3, U4, U5>();
+}
+
+/**********************************************************************************************/
+template<class T1, class T2, class T3, class T4, class T5, class T6, class U1, class U2, class U3, class U4, class U5, class U6>
+constexpr int compare_types() {
+    if(constexpr int r = compare_types<T1, U1>() ) {
+        return r;
+    }
+    return compare_types<T2, T3, T4, T5, T6, U2, U3, U4, U5, U6>();
+}
+
+/**********************************************************************************************/
+template<class F1, class F2>
+struct compare_functions_impl;
+
+/**********************************************************************************************/
+template<class R1, class R2, class... Args1, class... Args2>
+struct compare_functions_impl<R1(*)(Args1...), R2(*)(Args2...)> {
+    static constexpr int value = compare_types<Args1..., Args2...>();
+};
+
+/**********************************************************************************************/
+template<>
+struct compare_functions_impl<void, void> {
+    static constexpr int value = 0;
+};
+
+/**********************************************************************************************/
+template<class F1, class F2>
+struct compare_functions final : public compare_functions_impl<signature_t<F1>, signature_t<F2>> {
+};
+
+
+/**********************************************************************************************/
+template<class F>
+struct function_traits_impl;
+
+/**********************************************************************************************/
+template<class R>
+struct function_traits_impl<R(*)()> {
+    enum { arity = 0 };
+    using ret_type = R;
+    using arg1_type = none_t;
+    using arg2_type = none_t;
+    using arg3_type = none_t;
+    using arg4_type = none_t;
+    using arg5_type = none_t;
+    using arg6_type = none_t;
+};
+
+/**********************************************************************************************/
+template<class R, class T1>
+struct function_traits_impl<R(*)(T1)> {
+    enum { arity = 1 };
+    using ret_type = R;
+    using arg1_type = T1;
+    using arg2_type = none_t;
+    using arg3_type = none_t;
+    using arg4_type = none_t;
+    using arg5_type = none_t;
+    using arg6_type = none_t;
+};
+
+/**********************************************************************************************/
+template<class R, class T1, class T2>
+struct function_traits_impl<R(*)(T1, T2)> {
+    enum { arity = 2 };
+    using ret_type = R;
+    using arg1_type = T1;
+    using arg2_type = T2;
+    using arg3_type = none_t;
+    using arg4_type = none_t;
+    using arg5_type = none_t;
+    using arg6_type = none_t;
+};
+
+/**********************************************************************************************/
+template<class R, class T1, class T2, class T3>
+struct function_traits_impl<R(*)(T1, T2, T3)> {
+    enum { arity = 3 };
+    using ret_type = R;
+    using arg1_type = T1;
+    using arg2_type = T2;
+    using arg3_type = T3;
+    using arg4_type = none_t;
+    using arg5_type = none_t;
+    using arg6_type = none_t;
+};
+
+/**********************************************************************************************/
+template<class R, class T1, class T2, class T3, class T4>
+struct function_traits_impl<R(*)(T1, T2, T3, T4)> {
+    enum { arity = 4 };
+    using ret_type = R;
+    using arg1_type = T1;
+    using arg2_type = T2;
+    using arg3_type = T3;
+    using arg4_type = T4;
+    using arg5_type = none_t;
+    using arg6_type = none_t;
+};
+
+template<class R, class T1, class T2, class T3, class T4, class T5>
+struct function_traits_impl<R(*)(T1, T2, T3, T4, T5)> {
+    enum { arity = 5 };
+    using ret_type = R;
+    using arg1_type = T1;
+    using arg2_type = T2;
+    using arg3_type = T3;
+    using arg4_type = T4;
+    using arg5_type = T5;
+    using arg6_type = none_t;
+};
+
+template<class R, class T1, class T2, class T3, class T4, class T5, class T6>
+struct function_traits_impl<R(*)(T1, T2, T3, T4, T5, T6)> {
+    enum { arity = 6 };
+    using ret_type = R;
+    using arg1_type = T1;
+    using arg2_type = T2;
+    using arg3_type = T3;
+    using arg4_type = T4;
+    using arg5_type = T5;
+    using arg6_type = T6;
+};
+
+/**********************************************************************************************/
+template<class F>
+struct function_traits : public function_traits_impl<signature_t<F>> {
+};
+
+/**********************************************************************************************/
+// Parameter of a function, by position.
+//
+template<class F, std::size_t K>
+using param_t = typename nth_type<K,
+    typename function_traits<F>::arg1_type, typename function_traits<F>::arg2_type, typename function_traits<F>::arg3_type,
+    typename function_traits<F>::arg4_type, typename function_traits<F>::arg5_type, typename function_traits<F>::arg6_type>::type;
+
+
+/**********************************************************************************************/
+// None of the classes of a sealed hierarchy derives from 'U'.
+//
+template<class U, class... C>
+constexpr bool sealed_disjoint(sealed_types<C...>) {
+    return !(... || (is_same_v<U, C> || is_base_of_v<U, C>));
+}
+
+/**********************************************************************************************/
+// Parameters' types are unrelated classes and no object may be of both of them: one class is final,
+// or all classes of a hierarchy are known from MM_SEALED. Otherwise a class that inherits both
+// of them makes both implementations applicable to the same arguments.
+//
+template<class T, class U>
+constexpr bool disjoint_types() {
+    using TD = decay_t<T>;
+    using UD = decay_t<U>;
+
+    if constexpr(is_same_v<TD, std::nullptr_t> || is_same_v<UD, std::nullptr_t>) {
+        return dynamic_class<TD>() || dynamic_class<UD>();
+    } else if constexpr(dynamic_class<TD>() && dynamic_class<UD>() && !is_base_of_v<TD, UD> && !is_base_of_v<UD, TD>) {
+        return std::is_final_v<TD> || std::is_final_v<UD> ||
+            (sealed_classes<TD>::type::size > 0 && sealed_disjoint<UD>(typename sealed_classes<TD>::type())) ||
+            (sealed_classes<UD>::type::size > 0 && sealed_disjoint<TD>(typename sealed_classes<UD>::type()));
+    } else {
+        return false;
+    }
+}
+
+/**********************************************************************************************/
+template<class F1, class F2>
+struct disjoint_functions final {
+    using T1 = function_traits<F1>;
+    using T2 = function_traits<F2>;
+
+    static constexpr bool value =
+        disjoint_types<typename T1::arg1_type, typename T2::arg1_type>() ||
+        disjoint_types<typename T1::arg2_type, typename T2::arg2_type>() ||
+        disjoint_types<typename T1::arg3_type, typename T2::arg3_type>() ||
+        disjoint_types<typename T1::arg4_type, typename T2::arg4_type>() ||
+        disjoint_types<typename T1::arg5_type, typename T2::arg5_type>() ||
+        disjoint_types<typename T1::arg6_type, typename T2::arg6_type>();
+};
+
+/**********************************************************************************************/
+template<>
+struct disjoint_functions<void, void> {
+    static constexpr bool value = false;
+};
+
+/**********************************************************************************************/
+// Parameter of the first implementation may take an argument of the second one's parameter type.
+//
+template<class T, class U>
+constexpr bool covering_types() {
+    if constexpr(any_param<T>()) {
+        return true;
+    } else if constexpr(poly_pointer<T>()) {
+        return is_same_v<decay_t<U>, std::nullptr_t> || is_base_of_v<param_class_t<T>, param_class_t<U>>;
+    } else {
+        return is_same_v<decay_t<T>, decay_t<U>> || is_base_of_v<decay_t<T>, decay_t<U>>;
+    }
+}
+
+/**********************************************************************************************/
+template<class F1, class F2>
+struct covering_functions final {
+    using T1 = function_traits<F1>;
+    using T2 = function_traits<F2>;
+
+    static constexpr bool value =
+        covering_types<typename T1::arg1_type, typename T2::arg1_type>() &&
+        covering_types<typename T1::arg2_type, typename T2::arg2_type>() &&
+        covering_types<typename T1::arg3_type, typename T2::arg3_type>() &&
+        covering_types<typename T1::arg4_type, typename T2::arg4_type>() &&
+        covering_types<typename T1::arg5_type, typename T2::arg5_type>() &&
+        covering_types<typename T1::arg6_type, typename T2::arg6_type>();
+};
+
+
+/**********************************************************************************************/
+// Implementation specializes a parameter of a prototype.
+//
+template<class T, class B>
+constexpr unsigned dispatched_param(unsigned bit) {
+    return is_same_v<decay_t<T>, decay_t<B>> || is_same_v<decay_t<T>, fallback_t> || is_same_v<T, none_t> ? 0 : bit;
+}
+
+/**********************************************************************************************/
+template<class P, class F>
+constexpr unsigned dispatched_params() {
+    using TP = function_traits<P>;
+    using TF = function_traits<F>;
+
+    return dispatched_param<typename TF::arg1_type, typename TP::arg1_type>(1) |
+           dispatched_param<typename TF::arg2_type, typename TP::arg2_type>(2) |
+           dispatched_param<typename TF::arg3_type, typename TP::arg3_type>(4) |
+           dispatched_param<typename TF::arg4_type, typename TP::arg4_type>(8) |
+           dispatched_param<typename TF::arg5_type, typename TP::arg5_type>(16) |
+           dispatched_param<typename TF::arg6_type, typename TP::arg6_type>(32);
+}
+
+
+/**********************************************************************************************/
+// Passes an argument to a parameter 'T' of an implementation. Rvalue references get the argument
+// as rvalue, values are copied, because next implementations may need them.
+//
+template<class T, class U>
+constexpr decltype(auto) forward_arg(U* u) {
+    if constexpr(std::is_rvalue_reference_v<T>) {
+        return std::move(*u);
+    } else {
+        return *u;
+    }
+}
+
+
+/**********************************************************************************************/
+#define MM_CAST_1 if(auto u1 = p1.template cast<typename function_traits<F>::arg1_type>(this->position_))
+#define MM_CAST_2 MM_CAST_1 if(auto u2 = p2.template cast<typename function_traits<F>::arg2_type>(this->position_))
+#define MM_CAST_3 MM_CAST_2 if(auto u3 = p3.template cast<typename function_traits<F>::arg3_type>(this->position_))
+#define MM_CAST_4 MM_CAST_3 if(auto u4 = p4.template cast<typename function_traits<F>::arg4_type>(this->position_))
+#define MM_CAST_5 MM_CAST_4 if(auto u5 = p5.template cast<typename function_traits<F>::arg5_type>(this->position_))
+#define MM_CAST_6 MM_CAST_5 if(auto u6 = p6.template cast<typename function_traits<F>::arg6_type>(this->position_))
+
+#define MM_ARGS_1 forward_arg<typename function_traits<F>::arg1_type>(u1)
+#define MM_ARGS_2 MM_ARGS_1, forward_arg<typename function_traits<F>::arg2_type>(u2)
+#define MM_ARGS_3 MM_ARGS_2, forward_arg<typename function_traits<F>::arg3_type>(u3)
+#define MM_ARGS_4 MM_ARGS_3, forward_arg<typename function_traits<F>::arg4_type>(u4)
+#define MM_ARGS_5 MM_ARGS_4, forward_arg<typename function_traits<F>::arg5_type>(u5)
+#define MM_ARGS_6 MM_ARGS_5, forward_arg<typename function_traits<F>::arg6_type>(u6)
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_0 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
+    const F f_;
+    constexpr explicit method_0(F f) : f_(f) {}
+
+    ret_t call() { MM_PROFILE_SELECT return ret_t { f_() }; }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_0_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    const F f_;
+    constexpr explicit method_0_void(F f) : f_(f) {}
+
+    bool call() { MM_PROFILE_SELECT f_(); return true; }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_1 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
+    const F f_;
+    constexpr explicit method_1(F f) : f_(f) {}
+
+    constexpr ret_t call(const arg<B1>& p1) {
+        MM_CAST_1 { MM_PROFILE_SELECT return ret_t { f_(MM_ARGS_1) }; }
+        return {};
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_1_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    const F f_;
+    constexpr explicit method_1_void(F f) : f_(f) {}
+
+    constexpr bool call(const arg<B1>& p1) {
+        MM_CAST_1 { MM_PROFILE_SELECT f_(MM_ARGS_1); return true; }
+        return false;
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_2 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
+    const F f_;
+    constexpr explicit method_2(F f) : f_(f) {}
+
+    constexpr ret_t call(const arg<B1>& p1, const arg<B2>& p2) {
+        MM_CAST_2 { MM_PROFILE_SELECT return ret_t { f_(MM_ARGS_2) }; }
+        return {};
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_2_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    const F f_;
+    constexpr explicit method_2_void(F f) : f_(f) {}
+
+    constexpr bool call(const arg<B1>& p1, const arg<B2>& p2) {
+        MM_CAST_2 { MM_PROFILE_SELECT f_(MM_ARGS_2); return true; }
+        return false;
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_3 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
+    const F f_;
+    constexpr explicit method_3(F f) : f_(f) {}
+
+    constexpr ret_t call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3) {
+        MM_CAST_3 { MM_PROFILE_SELECT return ret_t { f_(MM_ARGS_3) }; }
+        return {};
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_3_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    const F f_;
+    constexpr explicit method_3_void(F f) : f_(f) {}
+
+    constexpr bool call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3) {
+        MM_CAST_3 { MM_PROFILE_SELECT f_(MM_ARGS_3); return true; }
+        return false;
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_4 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
+    const F f_;
+    constexpr explicit method_4(F f) : f_(f) {}
+
+    constexpr ret_t call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3, const arg<B4>& p4) {
+        MM_CAST_4 { MM_PROFILE_SELECT return ret_t { f_(MM_ARGS_4) }; }
+        return {};
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_4_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    const F f_;
+    constexpr explicit method_4_void(F f) : f_(f) {}
+
+    constexpr bool call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3, const arg<B4>& p4) {
+        MM_CAST_4 { MM_PROFILE_SELECT f_(MM_ARGS_4); return true; }
+        return false;
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_5 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
+    const F f_;
+    constexpr explicit method_5(F f) : f_(f) {}
+
+    constexpr ret_t call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3, const arg<B4>& p4, const arg<B5>& p5) {
+        MM_CAST_5 { MM_PROFILE_SELECT return ret_t { f_(MM_ARGS_5) }; }
+        return {};
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_5_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    const F f_;
+    constexpr explicit method_5_void(F f) : f_(f) {}
+
+    constexpr bool call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3, const arg<B4>& p4, const arg<B5>& p5) {
+        MM_CAST_5 { MM_PROFILE_SELECT f_(MM_ARGS_5); return true; }
+        return false;
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_6 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
+    const F f_;
+    constexpr explicit method_6(F f) : f_(f) {}
+
+    constexpr ret_t call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3, const arg<B4>& p4, const arg<B5>& p5, const arg<B6>& p6) {
+        MM_CAST_6 { MM_PROFILE_SELECT return ret_t { f_(MM_ARGS_6) }; }
+        return {};
+    }
+};
+
+/**********************************************************************************************/
+template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
+struct method_6_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
+    const F f_;
+    constexpr explicit method_6_void(F f) : f_(f) {}
+
+    constexpr bool call(const arg<B1>& p1, const arg<B2>& p2, const arg<B3>& p3, const arg<B4>& p4, const arg<B5>& p5, const arg<B6>& p6) {
+        MM_CAST_6 { MM_PROFILE_SELECT f_(MM_ARGS_6); return true; }
+        return false;
+    }
+};
+
+/**********************************************************************************************/
+#undef MM_CAST_1
+#undef MM_CAST_2
+#undef MM_CAST_3
+#undef MM_CAST_4
+#undef MM_CAST_5
+#undef MM_CAST_6
+#undef MM_ARGS_1
+#undef MM_ARGS_2
+#undef MM_ARGS_3
+#undef MM_ARGS_4
+#undef MM_ARGS_5
+#undef MM_ARGS_6
+
+/**********************************************************************************************/
+template<class T>
+const std::type_info* parameter_type() {
+    return is_same_v<T, none_t> ? nullptr : &typeid(decay_t<T>);
+}
+
+/**********************************************************************************************/
 template<class F>
-struct function_traits_impl;
+void parameter_types(const std::type_info** r) {
+    using traits = function_traits<F>;
+
+    r[0] = parameter_type<typename traits::arg1_type>();
+    r[1] = parameter_type<typename traits::arg2_type>();
+    r[2] = parameter_type<typename traits::arg3_type>();
+    r[3] = parameter_type<typename traits::arg4_type>();
+    r[4] = parameter_type<typename traits::arg5_type>();
+    r[5] = parameter_type<typename traits::arg6_type>();
+}
+
+/**********************************************************************************************/
+template<class B1, class B2, class B3, class B4, class B5, class B6, class F>
+void parameter_casts(void* (**r)(void*)) {
+    using traits = function_traits<F>;
+
+    r[0] = &cast_parameter<B1, typename traits::arg1_type>;
+    r[1] = &cast_parameter<B2, typename traits::arg2_type>;
+    r[2] = &cast_parameter<B3, typename traits::arg3_type>;
+    r[3] = &cast_parameter<B4, typename traits::arg4_type>;
+    r[4] = &cast_parameter<B5, typename traits::arg5_type>;
+    r[5] = &cast_parameter<B6, typename traits::arg6_type>;
+}
+
+/**********************************************************************************************/
+template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline
+auto make_method(bool /*dummy*/) {
+    return nullptr;
+}
+
+/**********************************************************************************************/
+#define MM_MAKE_METHOD(N) \
+    template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline \
+    auto make_method(F f) -> enable_if_t<function_traits<F>::arity == (N) && !is_same_v<void, typename function_traits<F>::ret_type>, abstract_method<T, B1, B2, B3, B4, B5, B6>*> { \
+        static_assert(function_traits<F>::arity == function_traits<P>::arity || is_same_v<typename function_traits<F>::arg1_type, fallback_t>, "Invalid count of implementation's parameters."); \
+        static_assert(check_parameters<P, F>::value, "Incompatible implementation's parameters types."); \
+        auto r = new method_ ## N<T, B1, B2, B3, B4, B5, B6, F>(f); \
+        r->fallback_ = is_same_v<fallback_t, typename function_traits<F>::arg1_type>; \
+        r->signature_ = &typeid(F); \
+        parameter_types<F>(r->types_); \
+        parameter_casts<B1, B2, B3, B4, B5, B6, F>(r->casts_); \
+        return r; \
+    } \
+    \
+    template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline \
+    auto make_method(F f) -> enable_if_t<function_traits<F>::arity == (N) && is_same_v<void, typename function_traits<F>::ret_type>, abstract_method<T, B1, B2, B3, B4, B5, B6>*> { \
+        static_assert(function_traits<F>::arity == function_traits<P>::arity || is_same_v<typename function_traits<F>::arg1_type, fallback_t>, "Invalid count of implementation's parameters."); \
+        static_assert(check_parameters<P, F>::value, "Incompatible implementation's parameters types."); \
+        auto r = new method_ ## N ## _void<T, B1, B2, B3, B4, B5, B6, F>(f); \
+        r->fallback_ = is_same_v<fallback_t, typename function_traits<F>::arg1_type>; \
+        r->signature_ = &typeid(F); \
+        parameter_types<F>(r->types_); \
+        parameter_casts<B1, B2, B3, B4, B5, B6, F>(r->casts_); \
+        return r; \
+    }
+
+/**********************************************************************************************/
+MM_MAKE_METHOD(0)
+MM_MAKE_METHOD(1)
+MM_MAKE_METHOD(2)
+MM_MAKE_METHOD(3)
+MM_MAKE_METHOD(4)
+MM_MAKE_METHOD(5)
+MM_MAKE_METHOD(6)
+
+/**********************************************************************************************/
+#undef MM_MAKE_METHOD
+
+/**********************************************************************************************/
+// Creates a primary implementation, qualified ones are created apart (see 'make_qualified').
+//
+template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline
+abstract_method<T, B1, B2, B3, B4, B5, B6>* make_primary(F f) {
+    if constexpr(is_same_v<typename qualifier<F>::type, void>) {
+        return make_method<P, T, B1, B2, B3, B4, B5, B6, F>(f);
+    } else {
+        return nullptr;
+    }
+}
+
+/**********************************************************************************************/
+template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline
+abstract_method<T, B1, B2, B3, B4, B5, B6>* make_primary(bool /*dummy*/) {
+    return nullptr;
+}
+
+
+/**********************************************************************************************/
+template<class T>
+struct method_result_impl {
+    static T unwrap(method_ret_type<T>& o) { return *o; }
+};
+
+/**********************************************************************************************/
+template<>
+struct method_result_impl<void> {
+    static void unwrap(bool /*v*/) {}
+};
+
+/**********************************************************************************************/
+template<class T>
+struct method_result final : public method_result_impl<T> {
+};
+
+/**********************************************************************************************/
+// Calls the fallback of a method or throws 'not_implemented' (see 'MM_CALL_FALLBACK').
+//
+template<class T, class B, class M>
+MM_COLD T dispatch_fallback(M* handler, const char* message) {
+    if(handler) {
+        if(auto r = handler->call(arg<B> { g_dummy_fallback })) {
+            return method_result<T>::unwrap(r);
+        }
+    }
+    throw_not_implemented(message);
+}
+
+// The same for algorithms that get methods as objects (see 'method_data').
+template<class T, class B, class M>
+MM_COLD T dispatch_fallback(const method_data<M>& data) {
+    if(data.fallback_) {
+        if(auto r = data.fallback_->call(arg<B> { g_dummy_fallback })) {
+            return method_result<T>::unwrap(r);
+        }
+    }
+    throw_method_not_implemented(data.name_);
+}
+
+
+/**********************************************************************************************/
+// Relations of pairs of implementations of a method, computed at compile time. Tables of bits
+// take less space than code, that compares types of each pair at runtime.
+//
+template<class I>
+struct impl_relations final {
+    static constexpr auto disjoint_ = I::template relation_table<&I::disjoint_pair>();
+    static constexpr auto covers_ = I::template relation_table<&I::covers_pair>();
+};
+
+/**********************************************************************************************/
+// Helper class to store and sort implementations.
+//
+template<class... Funcs>
+struct method_impls final {
+    const std::tuple<bool, Funcs...> funcs_;
+    constexpr explicit method_impls( std::tuple<bool, Funcs...>&& funcs ) : funcs_(funcs) {}
+
+    static constexpr int N = sizeof...(Funcs);
+    static_assert(N < 65, "Too many implementations.");
+
+    #define MM_FUNC_TYPE(I) \
+        using F ## I = typename nth_type<((I) < N ? (I) : 0), Funcs...>::type
+
+    MM_FUNC_TYPE(0); MM_FUNC_TYPE(1); MM_FUNC_TYPE(2); MM_FUNC_TYPE(3);
+    MM_FUNC_TYPE(4); MM_FUNC_TYPE(5); MM_FUNC_TYPE(6); MM_FUNC_TYPE(7);
+    MM_FUNC_TYPE(8); MM_FUNC_TYPE(9); MM_FUNC_TYPE(10); MM_FUNC_TYPE(11);
+    MM_FUNC_TYPE(12); MM_FUNC_TYPE(13); MM_FUNC_TYPE(14); MM_FUNC_TYPE(15);
+    MM_FUNC_TYPE(16); MM_FUNC_TYPE(17); MM_FUNC_TYPE(18); MM_FUNC_TYPE(19);
+    MM_FUNC_TYPE(20); MM_FUNC_TYPE(21); MM_FUNC_TYPE(22); MM_FUNC_TYPE(23);
+    MM_FUNC_TYPE(24); MM_FUNC_TYPE(25); MM_FUNC_TYPE(26); MM_FUNC_TYPE(27);
+    MM_FUNC_TYPE(28); MM_FUNC_TYPE(29); MM_FUNC_TYPE(30); MM_FUNC_TYPE(31);
+    MM_FUNC_TYPE(32); MM_FUNC_TYPE(33); MM_FUNC_TYPE(34); MM_FUNC_TYPE(35);
+    MM_FUNC_TYPE(36); MM_FUNC_TYPE(37); MM_FUNC_TYPE(38); MM_FUNC_TYPE(39);
+    MM_FUNC_TYPE(40); MM_FUNC_TYPE(41); MM_FUNC_TYPE(42); MM_FUNC_TYPE(43);
+    MM_FUNC_TYPE(44); MM_FUNC_TYPE(45); MM_FUNC_TYPE(46); MM_FUNC_TYPE(47);
+    MM_FUNC_TYPE(48); MM_FUNC_TYPE(49); MM_FUNC_TYPE(50); MM_FUNC_TYPE(51);
+    MM_FUNC_TYPE(52); MM_FUNC_TYPE(53); MM_FUNC_TYPE(54); MM_FUNC_TYPE(55);
+    MM_FUNC_TYPE(56); MM_FUNC_TYPE(57); MM_FUNC_TYPE(58); MM_FUNC_TYPE(59);
+    MM_FUNC_TYPE(60); MM_FUNC_TYPE(61); MM_FUNC_TYPE(62); MM_FUNC_TYPE(63);
+
+    #undef MM_FUNC_TYPE
+
+    // Predicate function to sort functions
+    template<class A>
+    static constexpr bool pred_b(int b) {
+        #define MM_CASE_B(I) \
+            if(b == (I)) return compare_functions<A, F ## I>::value < 0;
+
+        MM_CASE_B(0); MM_CASE_B(1); MM_CASE_B(2); MM_CASE_B(3);
+        MM_CASE_B(4); MM_CASE_B(5); MM_CASE_B(6); MM_CASE_B(7);
+        MM_CASE_B(8); MM_CASE_B(9); MM_CASE_B(10); MM_CASE_B(11);
+        MM_CASE_B(12); MM_CASE_B(13); MM_CASE_B(14); MM_CASE_B(15);
+        MM_CASE_B(16); MM_CASE_B(17); MM_CASE_B(18); MM_CASE_B(19);
+        MM_CASE_B(20); MM_CASE_B(21); MM_CASE_B(22); MM_CASE_B(23);
+        MM_CASE_B(24); MM_CASE_B(25); MM_CASE_B(26); MM_CASE_B(27);
+        MM_CASE_B(28); MM_CASE_B(29); MM_CASE_B(30); MM_CASE_B(31);
+        MM_CASE_B(32); MM_CASE_B(33); MM_CASE_B(34); MM_CASE_B(35);
+        MM_CASE_B(36); MM_CASE_B(37); MM_CASE_B(38); MM_CASE_B(39);
+        MM_CASE_B(40); MM_CASE_B(41); MM_CASE_B(42); MM_CASE_B(43);
+        MM_CASE_B(44); MM_CASE_B(45); MM_CASE_B(46); MM_CASE_B(47);
+        MM_CASE_B(48); MM_CASE_B(49); MM_CASE_B(50); MM_CASE_B(51);
+        MM_CASE_B(52); MM_CASE_B(53); MM_CASE_B(54); MM_CASE_B(55);
+        MM_CASE_B(56); MM_CASE_B(57); MM_CASE_B(58); MM_CASE_B(59);
+        MM_CASE_B(60); MM_CASE_B(61); MM_CASE_B(62); MM_CASE_B(63);
+
+        #undef MM_CASE_B
+
+        return false;
+    }
+
+    // Bit mask of parameters, that are specialized by at least one function
+    template<class P>
+    constexpr unsigned dispatched_mask() const {
+        return (dispatched_params<P, Funcs>() | ... | 0u);
+    }
+
+    // Checks that functions never apply to the same arguments
+    template<class A>
+    static constexpr bool disjoint_b(int b) {
+        #define MM_CASE_B(I) \
+            if(b == (I)) return disjoint_functions<A, F ## I>::value;
+
+        MM_CASE_B(0); MM_CASE_B(1); MM_CASE_B(2); MM_CASE_B(3);
+        MM_CASE_B(4); MM_CASE_B(5); MM_CASE_B(6); MM_CASE_B(7);
+        MM_CASE_B(8); MM_CASE_B(9); MM_CASE_B(10); MM_CASE_B(11);
+        MM_CASE_B(12); MM_CASE_B(13); MM_CASE_B(14); MM_CASE_B(15);
+        MM_CASE_B(16); MM_CASE_B(17); MM_CASE_B(18); MM_CASE_B(19);
+        MM_CASE_B(20); MM_CASE_B(21); MM_CASE_B(22); MM_CASE_B(23);
+        MM_CASE_B(24); MM_CASE_B(25); MM_CASE_B(26); MM_CASE_B(27);
+        MM_CASE_B(28); MM_CASE_B(29); MM_CASE_B(30); MM_CASE_B(31);
+        MM_CASE_B(32); MM_CASE_B(33); MM_CASE_B(34); MM_CASE_B(35);
+        MM_CASE_B(36); MM_CASE_B(37); MM_CASE_B(38); MM_CASE_B(39);
+        MM_CASE_B(40); MM_CASE_B(41); MM_CASE_B(42); MM_CASE_B(43);
+        MM_CASE_B(44); MM_CASE_B(45); MM_CASE_B(46); MM_CASE_B(47);
+        MM_CASE_B(48); MM_CASE_B(49); MM_CASE_B(50); MM_CASE_B(51);
+        MM_CASE_B(52); MM_CASE_B(53); MM_CASE_B(54); MM_CASE_B(55);
+        MM_CASE_B(56); MM_CASE_B(57); MM_CASE_B(58); MM_CASE_B(59);
+        MM_CASE_B(60); MM_CASE_B(61); MM_CASE_B(62); MM_CASE_B(63);
+
+        #undef MM_CASE_B
+
+        return false;
+    }
+
+    static constexpr bool disjoint_pair(int a, int b) {
+        #define MM_CASE_A(I) \
+            if(a == (I)) return disjoint_b<F ## I>(b)
+
+        MM_CASE_A(0); MM_CASE_A(1); MM_CASE_A(2); MM_CASE_A(3);
+        MM_CASE_A(4); MM_CASE_A(5); MM_CASE_A(6); MM_CASE_A(7);
+        MM_CASE_A(8); MM_CASE_A(9); MM_CASE_A(10); MM_CASE_A(11);
+        MM_CASE_A(12); MM_CASE_A(13); MM_CASE_A(14); MM_CASE_A(15);
+        MM_CASE_A(16); MM_CASE_A(17); MM_CASE_A(18); MM_CASE_A(19);
+        MM_CASE_A(20); MM_CASE_A(21); MM_CASE_A(22); MM_CASE_A(23);
+        MM_CASE_A(24); MM_CASE_A(25); MM_CASE_A(26); MM_CASE_A(27);
+        MM_CASE_A(28); MM_CASE_A(29); MM_CASE_A(30); MM_CASE_A(31);
+        MM_CASE_A(32); MM_CASE_A(33); MM_CASE_A(34); MM_CASE_A(35);
+        MM_CASE_A(36); MM_CASE_A(37); MM_CASE_A(38); MM_CASE_A(39);
+        MM_CASE_A(40); MM_CASE_A(41); MM_CASE_A(42); MM_CASE_A(43);
+        MM_CASE_A(44); MM_CASE_A(45); MM_CASE_A(46); MM_CASE_A(47);
+        MM_CASE_A(48); MM_CASE_A(49); MM_CASE_A(50); MM_CASE_A(51);
+        MM_CASE_A(52); MM_CASE_A(53); MM_CASE_A(54); MM_CASE_A(55);
+        MM_CASE_A(56); MM_CASE_A(57); MM_CASE_A(58); MM_CASE_A(59);
+        MM_CASE_A(60); MM_CASE_A(61); MM_CASE_A(62); MM_CASE_A(63);
+
+        #undef MM_CASE_A
+
+        return false;
+    }
+
+    // Checks that the first function may apply to arguments of types of the second one
+    template<class A>
+    static constexpr bool covers_b(int b) {
+        #define MM_CASE_B(I) \
+            if(b == (I)) return covering_functions<A, F ## I>::value;
+
+        MM_CASE_B(0); MM_CASE_B(1); MM_CASE_B(2); MM_CASE_B(3);
+        MM_CASE_B(4); MM_CASE_B(5); MM_CASE_B(6); MM_CASE_B(7);
+        MM_CASE_B(8); MM_CASE_B(9); MM_CASE_B(10); MM_CASE_B(11);
+        MM_CASE_B(12); MM_CASE_B(13); MM_CASE_B(14); MM_CASE_B(15);
+        MM_CASE_B(16); MM_CASE_B(17); MM_CASE_B(18); MM_CASE_B(19);
+        MM_CASE_B(20); MM_CASE_B(21); MM_CASE_B(22); MM_CASE_B(23);
+        MM_CASE_B(24); MM_CASE_B(25); MM_CASE_B(26); MM_CASE_B(27);
+        MM_CASE_B(28); MM_CASE_B(29); MM_CASE_B(30); MM_CASE_B(31);
+        MM_CASE_B(32); MM_CASE_B(33); MM_CASE_B(34); MM_CASE_B(35);
+        MM_CASE_B(36); MM_CASE_B(37); MM_CASE_B(38); MM_CASE_B(39);
+        MM_CASE_B(40); MM_CASE_B(41); MM_CASE_B(42); MM_CASE_B(43);
+        MM_CASE_B(44); MM_CASE_B(45); MM_CASE_B(46); MM_CASE_B(47);
+        MM_CASE_B(48); MM_CASE_B(49); MM_CASE_B(50); MM_CASE_B(51);
+        MM_CASE_B(52); MM_CASE_B(53); MM_CASE_B(54); MM_CASE_B(55);
+        MM_CASE_B(56); MM_CASE_B(57); MM_CASE_B(58); MM_CASE_B(59);
+        MM_CASE_B(60); MM_CASE_B(61); MM_CASE_B(62); MM_CASE_B(63);
+
+        #undef MM_CASE_B
+
+        return false;
+    }
+
+    static constexpr bool covers_pair(int a, int b) {
+        #define MM_CASE_A(I) \
+            if(a == (I)) return covers_b<F ## I>(b)
+
+        MM_CASE_A(0); MM_CASE_A(1); MM_CASE_A(2); MM_CASE_A(3);
+        MM_CASE_A(4); MM_CASE_A(5); MM_CASE_A(6); MM_CASE_A(7);
+        MM_CASE_A(8); MM_CASE_A(9); MM_CASE_A(10); MM_CASE_A(11);
+        MM_CASE_A(12); MM_CASE_A(13); MM_CASE_A(14); MM_CASE_A(15);
+        MM_CASE_A(16); MM_CASE_A(17); MM_CASE_A(18); MM_CASE_A(19);
+        MM_CASE_A(20); MM_CASE_A(21); MM_CASE_A(22); MM_CASE_A(23);
+        MM_CASE_A(24); MM_CASE_A(25); MM_CASE_A(26); MM_CASE_A(27);
+        MM_CASE_A(28); MM_CASE_A(29); MM_CASE_A(30); MM_CASE_A(31);
+        MM_CASE_A(32); MM_CASE_A(33); MM_CASE_A(34); MM_CASE_A(35);
+        MM_CASE_A(36); MM_CASE_A(37); MM_CASE_A(38); MM_CASE_A(39);
+        MM_CASE_A(40); MM_CASE_A(41); MM_CASE_A(42); MM_CASE_A(43);
+        MM_CASE_A(44); MM_CASE_A(45); MM_CASE_A(46); MM_CASE_A(47);
+        MM_CASE_A(48); MM_CASE_A(49); MM_CASE_A(50); MM_CASE_A(51);
+        MM_CASE_A(52); MM_CASE_A(53); MM_CASE_A(54); MM_CASE_A(55);
+        MM_CASE_A(56); MM_CASE_A(57); MM_CASE_A(58); MM_CASE_A(59);
+        MM_CASE_A(60); MM_CASE_A(61); MM_CASE_A(62); MM_CASE_A(63);
+
+        #undef MM_CASE_A
+
+        return false;
+    }
+
+    // Relation of all pairs of functions: bit 'b' of 'r[a]'.
+    template<bool (*R)(int, int)>
+    static constexpr array<std::uint64_t, N> relation_table() {
+        array<std::uint64_t, N> r {};
+        for(int a = 0 ; a < N ; ++a) {
+            for(int b = 0 ; b < N ; ++b) {
+                r[a] |= R(a, b) ? std::uint64_t(1) << b : 0;
+            }
+        }
+        return r;
+    }
+
+    static bool relation(const array<std::uint64_t, N>& table, int a, int b) {
+        return a >= 0 && a < N && b >= 0 && b < N && (table[a] >> b & 1);
+    }
+
+    // Functions never apply to the same arguments (by indexes in a definition).
+    static bool disjoint(int a, int b) { return relation(impl_relations<method_impls>::disjoint_, a, b); }
+
+    // The first function may apply to arguments of types of the second one.
+    static bool covers(int a, int b) { return relation(impl_relations<method_impls>::covers_, a, b); }
+
+    static constexpr bool pred(int a, int b) {
+        #define MM_CASE_A(I) \
+            if(a == (I)) return method_impls::pred_b<F ## I>(b)
+
+        MM_CASE_A(0); MM_CASE_A(1); MM_CASE_A(2); MM_CASE_A(3);
+        MM_CASE_A(4); MM_CASE_A(5); MM_CASE_A(6); MM_CASE_A(7);
+        MM_CASE_A(8); MM_CASE_A(9); MM_CASE_A(10); MM_CASE_A(11);
+        MM_CASE_A(12); MM_CASE_A(13); MM_CASE_A(14); MM_CASE_A(15);
+        MM_CASE_A(16); MM_CASE_A(17); MM_CASE_A(18); MM_CASE_A(19);
+        MM_CASE_A(20); MM_CASE_A(21); MM_CASE_A(22); MM_CASE_A(23);
+        MM_CASE_A(24); MM_CASE_A(25); MM_CASE_A(26); MM_CASE_A(27);
+        MM_CASE_A(28); MM_CASE_A(29); MM_CASE_A(30); MM_CASE_A(31);
+        MM_CASE_A(32); MM_CASE_A(33); MM_CASE_A(34); MM_CASE_A(35);
+        MM_CASE_A(36); MM_CASE_A(37); MM_CASE_A(38); MM_CASE_A(39);
+        MM_CASE_A(40); MM_CASE_A(41); MM_CASE_A(42); MM_CASE_A(43);
+        MM_CASE_A(44); MM_CASE_A(45); MM_CASE_A(46); MM_CASE_A(47);
+        MM_CASE_A(48); MM_CASE_A(49); MM_CASE_A(50); MM_CASE_A(51);
+        MM_CASE_A(52); MM_CASE_A(53); MM_CASE_A(54); MM_CASE_A(55);
+        MM_CASE_A(56); MM_CASE_A(57); MM_CASE_A(58); MM_CASE_A(59);
+        MM_CASE_A(60); MM_CASE_A(61); MM_CASE_A(62); MM_CASE_A(63);
+
+        #undef MM_CASE_A
+
+        return a < b;
+    }
+
+    // Indexes of functions in order of dispatching. Insertion sort, so the order is the same
+    // for the dispatcher and for code generated at compile time (see 'sealed_dispatch').
+    static constexpr array<int, N> sorted_indexes() {
+        array<int, N> r {};
+        for(int i = 0 ; i < N ; ++i) {
+            r[i] = i;
+        }
+
+        for(int i = 1 ; i < N ; ++i) {
+            const int v = r[i];
+            int j = i;
+            if(pred(v, r[0])) {
+                for( ; j > 0 ; --j) {
+                    r[j] = r[j - 1];
+                }
+            } else {
+                for( ; pred(v, r[j - 1]) ; --j) {
+                    r[j] = r[j - 1];
+                }
+            }
+            r[j] = v;
+        }
+
+        return r;
+    }
+
+    // Sorts functions and returns array with instances of 'abstract_method'
+    template<class TP, class TR, class BR1, class BR2, class BR3, class BR4, class BR5, class BR6>
+    auto to_array() const {
+        // Use indexes cause we cannot sort tuple itself
+        const array<int, N> indexes = sorted_indexes();
+
+        // Create and fill array with implementations
+        array<abstract_method<TR, BR1, BR2, BR3, BR4, BR5, BR6>*, N> r {};
+
+        for(int i = 0 ; i < N ; ++i) {
+            switch(indexes[i]) {
+                #define MM_FILL_VECTOR(I) \
+                    case I: r[i] = make_primary<TP, TR, BR1, BR2, BR3, BR4, BR5, BR6, F ## I>(std::get<(I) < N ? (I) + 1 : 0>(funcs_)); break
+
+                MM_FILL_VECTOR(0); MM_FILL_VECTOR(1); MM_FILL_VECTOR(2); MM_FILL_VECTOR(3);
+                MM_FILL_VECTOR(4); MM_FILL_VECTOR(5); MM_FILL_VECTOR(6); MM_FILL_VECTOR(7);
+                MM_FILL_VECTOR(8); MM_FILL_VECTOR(9); MM_FILL_VECTOR(10); MM_FILL_VECTOR(11);
+                MM_FILL_VECTOR(12); MM_FILL_VECTOR(13); MM_FILL_VECTOR(14); MM_FILL_VECTOR(15);
+                MM_FILL_VECTOR(16); MM_FILL_VECTOR(17); MM_FILL_VECTOR(18); MM_FILL_VECTOR(19);
+                MM_FILL_VECTOR(20); MM_FILL_VECTOR(21); MM_FILL_VECTOR(22); MM_FILL_VECTOR(23);
+                MM_FILL_VECTOR(24); MM_FILL_VECTOR(25); MM_FILL_VECTOR(26); MM_FILL_VECTOR(27);
+                MM_FILL_VECTOR(28); MM_FILL_VECTOR(29); MM_FILL_VECTOR(30); MM_FILL_VECTOR(31);
+                MM_FILL_VECTOR(32); MM_FILL_VECTOR(33); MM_FILL_VECTOR(34); MM_FILL_VECTOR(35);
+                MM_FILL_VECTOR(36); MM_FILL_VECTOR(37); MM_FILL_VECTOR(38); MM_FILL_VECTOR(39);
+                MM_FILL_VECTOR(40); MM_FILL_VECTOR(41); MM_FILL_VECTOR(42); MM_FILL_VECTOR(43);
+                MM_FILL_VECTOR(44); MM_FILL_VECTOR(45); MM_FILL_VECTOR(46); MM_FILL_VECTOR(47);
+                MM_FILL_VECTOR(48); MM_FILL_VECTOR(49); MM_FILL_VECTOR(50); MM_FILL_VECTOR(51);
+                MM_FILL_VECTOR(52); MM_FILL_VECTOR(53); MM_FILL_VECTOR(54); MM_FILL_VECTOR(55);
+                MM_FILL_VECTOR(56); MM_FILL_VECTOR(57); MM_FILL_VECTOR(58); MM_FILL_VECTOR(59);
+                MM_FILL_VECTOR(60); MM_FILL_VECTOR(61); MM_FILL_VECTOR(62); MM_FILL_VECTOR(63);
+
+                #undef MM_FILL_VECTOR
+
+                default:;
+            }
+
+            if(r[i]) {
+                r[i]->source_ = indexes[i];
+            }
+        }
+
+        return r;
+    }
+
+    // Count of implementations qualified with 'Q'.
+    template<class Q>
+    static constexpr int qualified_count() {
+        return (0 + ... + int(is_same_v<typename qualifier<Funcs>::type, Q>));
+    }
+
+    // Creates implementations qualified with 'Q' in order of dispatching.
+    template<class Q, class TP, class TR, class BR1, class BR2, class BR3, class BR4, class BR5, class BR6>
+    void make_qualified(abstract_method<TR, BR1, BR2, BR3, BR4, BR5, BR6>** r) const {
+        make_qualified<Q, TP>(r, std::index_sequence_for<Funcs...>());
+    }
+
+private:
+    template<class Q, class TP, class TR, class BR1, class BR2, class BR3, class BR4, class BR5, class BR6, std::size_t... I>
+    void make_qualified(abstract_method<TR, BR1, BR2, BR3, BR4, BR5, BR6>** r, std::index_sequence<I...>) const {
+        for(int index : sorted_indexes()) {
+            ((static_cast<int>(I) == index ? add_qualified<Q, TP>(r, index, std::get<I + 1>(funcs_)) : void()), ...);
+        }
+    }
+
+    template<class Q, class TP, class TR, class BR1, class BR2, class BR3, class BR4, class BR5, class BR6, class F>
+    static void add_qualified(abstract_method<TR, BR1, BR2, BR3, BR4, BR5, BR6>**& r, int index, F f) {
+        if constexpr(is_same_v<typename qualifier<F>::type, Q>) {
+            *r = make_method<TP, TR, BR1, BR2, BR3, BR4, BR5, BR6, F>(f);
+            (*r++)->source_ = index;
+        }
+    }
+};
+
+
+/**********************************************************************************************/
+// Calls the function 'K' of 'S' (a sorter of a method) with addresses of arguments already cast
+// to its parameters' types. The function is a constant, so the compiler may inline it, and
+// dispatch handles call it without casts and virtual calls.
+//
+template<const auto& S, class T, std::size_t K,
+         class J = std::make_index_sequence<function_traits<decay_t<decltype(std::get<K + 1>(S.funcs_))>>::arity>>
+struct direct_call;
+
+template<const auto& S, class T, std::size_t K, std::size_t... J>
+struct direct_call<S, T, K, std::index_sequence<J...>> final {
+    static T call(void* const* args) {
+        constexpr auto f = std::get<K + 1>(S.funcs_);
+        using F = decay_t<decltype(f)>;
+        return f(forward_arg<param_t<F, J>>(static_cast<remove_reference_t<param_t<F, J>>*>(args[J]))...);
+    }
+};
+
+/**********************************************************************************************/
+template<const auto& S, class T, std::size_t K>
+constexpr auto direct_entry() {
+    if constexpr(is_same_v<typename qualifier<decay_t<decltype(std::get<K + 1>(S.funcs_))>>::type, void>) {
+        return &direct_call<S, T, K>::call;
+    } else {
+        return static_cast<T (*)(void* const*)>(nullptr);
+    }
+}
+
+/**********************************************************************************************/
+// Direct calls of primary implementations of 'S', by indexes in a definition of a method.
+//
+template<const auto& S, class T, std::size_t... K>
+constexpr auto direct_calls(std::index_sequence<K...>) {
+    return array<T (*)(void* const*), sizeof...(K)> { direct_entry<S, T, K>()... };
+}
+
+template<const auto& S, class T, class... B, std::size_t N>
+constexpr auto direct_calls(const array<abstract_method<T, B...>*, N>& /*impls*/) {
+    return direct_calls<S, T>(std::make_index_sequence<N>());
+}
+
+/**********************************************************************************************/
+template<class T>
+using sealed_ret_t = conditional_t<is_same_v<T, void>, bool, method_ret_type<T>>;
+
+/**********************************************************************************************/
+// Order of dispatching, computed once for each method.
+//
+template<class I>
+struct sealed_order final {
+    static constexpr auto value = I::sorted_indexes();
+};
+
+/**********************************************************************************************/
+// Index of a dynamic type in a sealed hierarchy by names of types, for types from other modules.
+//
+template<class... T>
+int sealed_index_by_name(sealed_types<T...>, const std::type_info& type) {
+    int r = -1;
+    int i = 0;
+    ((type == typeid(T) ? (r = i, true) : (++i, false)) || ...);
+    return r;
+}
+
+/**********************************************************************************************/
+// Index of a dynamic type in a sealed hierarchy or -1.
+//
+template<class... T>
+int sealed_index(sealed_types<T...> types, const std::type_info& type) {
+    int r = -1;
+    int i = 0;
+    ((&type == &typeid(T) ? (r = i, true) : (++i, false)) || ...);
+    return r >= 0 ? r : sealed_index_by_name(types, type);
+}
+
+/**********************************************************************************************/
+// Index of an argument's class in its sealed hierarchy, by a tag or a dynamic type.
+//
+template<class A>
+int sealed_index(A& a) {
+    using classes_t = typename sealed_classes<decay_t<A>>::type;
+
+    if constexpr(classes_t::size == 0) {
+        return -1;
+    } else if constexpr(tagged_class<decay_t<A>>()) {
+        return tagged_index(classes_t(), mm_type_id(a));
+    } else {
+        return sealed_index(classes_t(), typeid(a));
+    }
+}
+
+/**********************************************************************************************/
+// Dynamic types of arguments are found by sealed hierarchies for all dispatched parameters.
+//
+template<class P, unsigned Mask, std::size_t K>
+constexpr int sealed_param_classes() {
+    if constexpr(!(Mask & (1u << K))) {
+        return 1;
+    } else if constexpr(std::is_lvalue_reference_v<param_t<P, K>> && dynamic_class<decay_t<param_t<P, K>>>()) {
+        return sealed_classes<decay_t<param_t<P, K>>>::type::size;
+    } else {
+        return 0;
+    }
+}
+
+// Hierarchies with more than 32 classes or too many tuples of classes are dispatched by the
+// cache (tags are still mapped to types of classes).
+template<class P, unsigned Mask, std::size_t... K>
+constexpr bool sealed_method(std::index_sequence<K...>) {
+    constexpr int counts[] = { 1, sealed_param_classes<P, Mask, K>()... };
+
+    long long tuples = 1;
+    for(int c : counts) {
+        if(c == 0 || c > 32) {
+            return false;
+        }
+        tuples *= c;
+    }
+
+    return Mask && tuples <= MM_SEALED_MAX_TUPLES;
+}
+
+/**********************************************************************************************/
+// Implementation's parameter takes an argument of the exact type 'C'.
+//
+template<class C, class T>
+constexpr bool sealed_accepts() {
+    return std::is_convertible_v<C*, remove_reference_t<T>*>;
+}
+
+template<class F, class... C, std::size_t... K>
+constexpr bool sealed_accepts(std::index_sequence<K...>) {
+    return (... && sealed_accepts<C, param_t<F, K>>());
+}
+
+/**********************************************************************************************/
+// Casts an argument to its dynamic type.
+//
+template<class C, class A, class = void>
+struct static_downcast : std::false_type {};
+
+template<class C, class A>
+struct static_downcast<C, A, std::void_t<decltype(static_cast<C*>(std::declval<A*>()))>> : std::true_type {};
+
+template<class C, class A>
+C& sealed_cast(A& a) {
+    using AD = decay_t<A>;
+    AD& v = const_cast<AD&>(a);
+
+    if constexpr(is_same_v<C, AD>) {
+        return v;
+    } else if constexpr(static_downcast<C, AD>::value) {
+        return *static_cast<C*>(&v);
+    } else {
+        return *dynamic_cast<C*>(&v);
+    }
+}
+
+/**********************************************************************************************/
+// Calls implementations of 'S' (a sorter of a method), that accept arguments of types 'C...',
+// in order of dispatching. Functions are constants, so the compiler may inline them.
+//
+template<const auto& S, class... C>
+struct sealed_call final {
+    using I = decay_t<decltype(S)>;
+
+    template<class F, std::size_t... K, class... A>
+    static decltype(auto) invoke(F f, std::index_sequence<K...>, A&... args) {
+        return f(forward_arg<param_t<F, K>>(&sealed_cast<C>(args))...);
+    }
+
+    template<int K, class T, class... A>
+    static sealed_ret_t<T> apply(A&... args) {
+        using ret_t = sealed_ret_t<T>;
+
+        if constexpr(K == I::N) {
+            return call_fallback<0, T>();
+        } else {
+            constexpr int s = sealed_order<I>::value[K];
+            constexpr auto f = std::get<s + 1>(S.funcs_);
+            using F = decay_t<decltype(f)>;
+
+            if constexpr(!is_same_v<decay_t<param_t<F, 0>>, fallback_t> &&
+                         sealed_accepts<F, C...>(std::index_sequence_for<C...>())) {
+                try {
+                    if constexpr(is_same_v<T, void>) {
+                        invoke(f, std::index_sequence_for<C...>(), args...);
+                        return ret_t { true };
+                    } else {
+                        return ret_t { invoke(f, std::index_sequence_for<C...>(), args...) };
+                    }
+                } catch(try_next&) {
+                }
+            }
+
+            return apply<K + 1, T>(args...);
+        }
+    }
+
+    // Index of the first implementation in order of dispatching (as in traces), -1 for none.
+    template<int K, int Index = 0>
+    static constexpr int first() {
+        if constexpr(K == I::N) {
+            return -1;
+        } else {
+            constexpr int s = sealed_order<I>::value[K];
+            using F = decay_t<decltype(std::get<s + 1>(S.funcs_))>;
+
+            if constexpr(is_same_v<decay_t<param_t<F, 0>>, fallback_t>) {
+                return first<K + 1, Index>();
+            } else if constexpr(sealed_accepts<F, C...>(std::index_sequence_for<C...>())) {
+                return Index;
+            } else {
+                return first<K + 1, Index + 1>();
+            }
+        }
+    }
+
+    template<int K, class T>
+    static sealed_ret_t<T> call_fallback() {
+        using ret_t = sealed_ret_t<T>;
+
+        if constexpr(K == I::N) {
+            return ret_t {};
+        } else {
+            constexpr auto f = std::get<K + 1>(S.funcs_);
+
+            if constexpr(is_same_v<decay_t<param_t<decay_t<decltype(f)>, 0>>, fallback_t>) {
+                if constexpr(is_same_v<T, void>) {
+                    f(g_dummy_fallback);
+                    return ret_t { true };
+                } else {
+                    return ret_t { f(g_dummy_fallback) };
+                }
+            } else {
+                return call_fallback<K + 1, T>();
+            }
+        }
+    }
+};
+
+/**********************************************************************************************/
+// Leaves of 'sealed_switch': call implementations, that accept arguments of classes 'C...', or
+// find the first of them without arguments.
+//
+template<class T>
+struct sealed_calls final {
+    using result_t = sealed_ret_t<T>;
+
+    template<const auto& S, class... C, class... A>
+    static result_t apply(A&... args) {
+        return sealed_call<S, C...>::template apply<0, T>(args...);
+    }
+};
+
+struct sealed_first final {
+    using result_t = int;
+
+    template<const auto& S, class... C>
+    static int apply() {
+        return sealed_call<S, C...>::template first<0>();
+    }
+};
+
+/**********************************************************************************************/
+// Nested switch over indexes of dynamic types of arguments in sealed hierarchies, parameters
+// that aren't dispatched keep their types.
+//
+template<const auto& S, class P, unsigned Mask, class L, class... C>
+struct sealed_switch final {
+    template<class... A>
+    static typename L::result_t call(const int* indexes, A&... args) {
+        constexpr std::size_t pos = sizeof...(C);
+
+        if constexpr(pos == function_traits<P>::arity) {
+            return L::template apply<S, C...>(args...);
+        } else if constexpr(!(Mask & (1u << pos))) {
+            return sealed_switch<S, P, Mask, L, C..., decay_t<param_t<P, pos>>>::call(indexes, args...);
+        } else {
+            using H = typename sealed_classes<decay_t<param_t<P, pos>>>::type;
+            static_assert(H::size <= 32, "Too many classes in a sealed hierarchy.");
+
+            switch(indexes[pos]) {
+                #define MM_SEALED_CASE(I) \
+                    case I: \
+                        if constexpr((I) < H::size) { \
+                            return sealed_switch<S, P, Mask, L, C..., typename H::template at<(I) < H::size ? (I) : 0>>::call(indexes, args...); \
+                        } \
+                        break
+
+                MM_SEALED_CASE(0); MM_SEALED_CASE(1); MM_SEALED_CASE(2); MM_SEALED_CASE(3);
+                MM_SEALED_CASE(4); MM_SEALED_CASE(5); MM_SEALED_CASE(6); MM_SEALED_CASE(7);
+                MM_SEALED_CASE(8); MM_SEALED_CASE(9); MM_SEALED_CASE(10); MM_SEALED_CASE(11);
+                MM_SEALED_CASE(12); MM_SEALED_CASE(13); MM_SEALED_CASE(14); MM_SEALED_CASE(15);
+                MM_SEALED_CASE(16); MM_SEALED_CASE(17); MM_SEALED_CASE(18); MM_SEALED_CASE(19);
+                MM_SEALED_CASE(20); MM_SEALED_CASE(21); MM_SEALED_CASE(22); MM_SEALED_CASE(23);
+                MM_SEALED_CASE(24); MM_SEALED_CASE(25); MM_SEALED_CASE(26); MM_SEALED_CASE(27);
+                MM_SEALED_CASE(28); MM_SEALED_CASE(29); MM_SEALED_CASE(30); MM_SEALED_CASE(31);
+
+                #undef MM_SEALED_CASE
+
+                default:;
+            }
+
+            return {}; // Unreachable
+        }
+    }
+};
+
+/**********************************************************************************************/
+template<unsigned Mask, std::size_t... K, class... A>
+void sealed_indexes(int* r, std::index_sequence<K...>, A&... args) {
+    ((r[K] = Mask & (1u << K) ? sealed_index(args) : 0), ...);
+}
+
+/**********************************************************************************************/
+// Dispatches a call with arguments of classes from sealed hierarchies, 'handled' is false for
+// other classes.
+//
+template<const auto& S, class P, unsigned Mask, class T, class... A>
+sealed_ret_t<T> sealed_dispatch(bool& handled, A&... args) {
+    int indexes[sizeof...(A)];
+    sealed_indexes<Mask>(indexes, std::index_sequence_for<A...>(), args...);
+
+    handled = std::find(indexes, indexes + sizeof...(A), -1) == indexes + sizeof...(A);
+    if(!handled) {
+        return {};
+    }
+    return sealed_switch<S, P, Mask, sealed_calls<T>>::call(indexes, args...);
+}
+
+/**********************************************************************************************/
+// Calls 'f' with a null pointer to the class with the index in a sealed hierarchy.
+//
+template<class... C, class F>
+void sealed_class_at(sealed_types<C...>, int index, F& f) {
+    int i = 0;
+    ((index == i++ ? (f(static_cast<C*>(nullptr)), true) : false) || ...);
+}
+
+
+/**********************************************************************************************/
+} // namespace detail
+
+
+/**********************************************************************************************/
+// Enables or disables counting of calls for each tuple of dynamic types of arguments.
+//
+inline void record_dispatch_profile(bool enable = true) {
+    detail::dispatch_cache_base::recording().store(enable, std::memory_order_relaxed);
+}
+
+/**********************************************************************************************/
+// Writes content of dispatch caches of all multimethods to a binary file:
+//
+//   "MMCACHE1"
+//   u32 count of methods, for each: string name, u16 count of impls, strings impls' types,
+//                                   u32 count of tuples, for each: u32 hits, i16 impl, u8 arity,
+//                                                                  strings types of arguments
+//
+// where impl is an index of registration of the first applicable implementation (-1 for none),
+// type of an argument is empty if no implementation specializes its parameter,
+// string is u16 length and characters without terminating zero.
+//
+inline bool save_dispatch_profile(const char* path) {
+    using detail::write_pod;
+    using detail::write_string;
+
+    std::FILE* f = std::fopen(path, "wb");
+    if(!f) {
+        return false;
+    }
+
+    std::fwrite("MMCACHE1", 1, 8, f);
+
+    const auto& methods = detail::method_info::methods();
+    write_pod(f, static_cast<std::uint32_t>(methods.size()));
+    for(auto m : methods) {
+        write_string(f, m->name_);
+        write_pod(f, static_cast<std::uint16_t>(m->signatures_.size()));
+        for(auto t : m->signatures_) {
+            write_string(f, t->name());
+        }
+
+        std::vector<detail::dispatch_cache_base::tuple_t> tuples;
+        if(m->cache_) {
+            m->cache_->tuples(tuples);
+        }
+
+        write_pod(f, static_cast<std::uint32_t>(tuples.size()));
+        for(auto& t : tuples) {
+            const int count = static_cast<int>(m->order_.size());
+            write_pod(f, t.hits_);
+            write_pod(f, static_cast<std::int16_t>(t.impl_ < count ? m->order_[t.impl_] : -1));
+            write_pod(f, static_cast<std::uint8_t>(m->arity_));
+            for(int i = 0 ; i < m->arity_ ; ++i) {
+                write_string(f, t.types_[i] ? t.types_[i]->name() : "");
+            }
+        }
+    }
+
+    return std::fclose(f) == 0;
+}
+
+/**********************************************************************************************/
+namespace detail {
+
+/**********************************************************************************************/
+// Moves frequently selected implementations to the beginning, but only past neighbours
+// that never apply to the same arguments (see 'disjoint_types'), so results of calls stay the same.
+//
+inline void reorder_by_hits(method_info& m, const std::vector<std::uint64_t>& hits) {
+    std::vector<int> order = m.order_;
+
+    for(std::size_t i = 1 ; i < order.size() ; ++i) {
+        for(std::size_t j = i ; j > 0 && hits[order[j]] > hits[order[j - 1]] && m.disjoint(order[j], order[j - 1]) ; --j) {
+            std::swap(order[j], order[j - 1]);
+        }
+    }
+
+    if(order != m.order_) {
+        m.reorder_(order);
+        m.order_ = order;
+        m.cache_->clear();
+    }
+}
+
+/**********************************************************************************************/
+struct loaded_tuple final {
+    std::uint32_t hits_ { 0 };
+    int impl_ { -1 };
+    int arity_ { 0 };
+    std::string names_[6];
+};
+
+/**********************************************************************************************/
+inline void load_tuples(method_info& m, const std::vector<loaded_tuple>& tuples) {
+    const int count = static_cast<int>(m.order_.size());
+
+    for(auto& t : tuples) {
+        if(t.arity_ != m.arity_) {
+            continue;
+        }
+
+        const int pos = t.impl_ < 0 ? count : static_cast<int>(std::find(m.order_.begin(), m.order_.end(), t.impl_) - m.order_.begin());
+
+        const std::type_info* types[6] {};
+        bool known = true;
+        std::string joined;
+
+        for(int i = 0 ; i < m.arity_ ; ++i) {
+            for(auto type : m.types_) {
+                if(t.names_[i] == type->name()) {
+                    types[i] = type;
+                }
+            }
+            known = known && (types[i] || t.names_[i].empty());
+            joined += t.names_[i];
+            joined += '\n';
+        }
+
+        // It's unknown which implementations after the first one apply, so all are tried
+        const std::uint64_t chain = chain_between(pos, count);
+
+        // Types without own implementations are resolved by names on the first call
+        if(known) {
+            m.cache_->insert(types, chain);
+        } else {
+            m.cache_->warm_[joined] = chain;
+        }
+    }
+}
 
 /**********************************************************************************************/
-template<class R>
-struct function_traits_impl<R(*)()> {
-    enum { arity = 0 };
-    using ret_type = R;
-    using arg1_type = none_t;
-    using arg2_type = none_t;
-    using arg3_type = none_t;
-    using arg4_type = none_t;
-    using arg5_type = none_t;
-    using arg6_type = none_t;
+} // namespace detail
+
+/**********************************************************************************************/
+// Fills dispatch caches from a file written by 'save_dispatch_profile'. Must be called before
+// calls of multimethods. Data of methods that were changed since saving are ignored.
+// If 'reorder' is true, implementations are ordered by frequency where that doesn't change
+// results of calls (see 'reorder_by_hits').
+//
+inline bool load_dispatch_profile(const char* path, bool reorder = false) {
+    using detail::read_pod;
+    using detail::read_string;
+
+    std::FILE* f = std::fopen(path, "rb");
+    if(!f) {
+        return false;
+    }
+
+    char magic[8];
+    std::uint32_t methods_count;
+    bool ok = std::fread(magic, 1, 8, f) == 8 && !std::memcmp(magic, "MMCACHE1", 8) && read_pod(f, methods_count);
+
+    for(std::uint32_t n = 0 ; ok && n < methods_count ; ++n) {
+        std::string name;
+        std::uint16_t impls_count;
+        ok = read_string(f, name) && read_pod(f, impls_count);
+
+        std::vector<std::string> signatures(ok ? impls_count : 0);
+        for(auto& s : signatures) {
+            ok = ok && read_string(f, s);
+        }
+
+        std::uint32_t tuples_count;
+        ok = ok && read_pod(f, tuples_count);
+
+        std::vector<detail::loaded_tuple> tuples(ok ? tuples_count : 0);
+        for(auto& t : tuples) {
+            std::int16_t impl;
+            std::uint8_t arity;
+            ok = ok && read_pod(f, t.hits_) && read_pod(f, impl) && read_pod(f, arity) && arity <= 6;
+            t.impl_ = impl < impls_count ? impl : -1;
+            t.arity_ = arity;
+            for(int i = 0 ; ok && i < arity ; ++i) {
+                ok = read_string(f, t.names_[i]);
+            }
+        }
+
+        if(!ok) {
+            break;
+        }
+
+        for(auto m : detail::method_info::methods()) {
+            bool same = m->cache_ && name == m->name_ && signatures.size() == m->signatures_.size();
+            for(std::size_t i = 0 ; same && i < signatures.size() ; ++i) {
+                same = signatures[i] == m->signatures_[i]->name();
+            }
+            if(!same) {
+                continue;
+            }
+
+            if(reorder) {
+                std::vector<std::uint64_t> hits(signatures.size(), 0);
+                for(auto& t : tuples) {
+                    if(t.impl_ >= 0) {
+                        hits[t.impl_] += t.hits_;
+                    }
+                }
+                detail::reorder_by_hits(*m, hits);
+            }
+
+            detail::load_tuples(*m, tuples);
+        }
+    }
+
+    std::fclose(f);
+    return ok;
+}
+
+/**********************************************************************************************/
+// Statistics of the dispatch cache of a multimethod.
+//
+struct cache_stats final {
+    std::string method_;
+    std::size_t tuples_ { 0 };      // Cached tuples of dynamic types.
+    std::size_t bytes_ { 0 };       // Memory of tables, including replaced ones.
+    std::size_t budget_ { 0 };      // Limit of memory for the method.
+    std::uint64_t evictions_ { 0 }; // Tuples replaced by other ones because tables are full.
+    std::uint64_t denied_ { 0 };    // Times tables weren't grown because of budgets.
+};
+
+/**********************************************************************************************/
+// Limits memory of dispatch caches of all multimethods (MM_CACHE_BUDGET by default). Caches
+// that already use more memory just stop growing.
+//
+inline void set_cache_budget(std::size_t bytes) {
+    detail::dispatch_cache_base::total_budget().store(bytes, std::memory_order_relaxed);
+}
+
+/**********************************************************************************************/
+// Limits memory of the dispatch cache of one multimethod, within the global budget:
+//
+//   multimethods::set_cache_budget(MM_METHOD(collide), 1 << 20);
+//
+template<class M>
+void set_cache_budget(const M& /*method*/, std::size_t bytes) {
+    M::data().info_.cache_->budget_.store(bytes, std::memory_order_relaxed);
+}
+
+/**********************************************************************************************/
+// Memory of dispatch caches of all multimethods.
+//
+inline std::size_t cache_memory() {
+    return detail::dispatch_cache_base::total_bytes().load(std::memory_order_relaxed);
+}
+
+/**********************************************************************************************/
+// Returns statistics of dispatch caches of all multimethods.
+//
+inline std::vector<cache_stats> cache_snapshot() {
+    std::vector<cache_stats> r;
+    std::vector<detail::dispatch_cache_base::tuple_t> tuples;
+
+    for(auto m : detail::method_info::methods()) {
+        if(!m->cache_) {
+            continue;
+        }
+
+        tuples.clear();
+        m->cache_->tuples(tuples);
+
+        cache_stats s;
+        s.method_ = m->name_;
+        s.tuples_ = tuples.size();
+        s.bytes_ = m->cache_->bytes_.load(std::memory_order_relaxed);
+        s.budget_ = m->cache_->budget_.load(std::memory_order_relaxed);
+        s.evictions_ = m->cache_->evictions_.load(std::memory_order_relaxed);
+        s.denied_ = m->cache_->denied_.load(std::memory_order_relaxed);
+        r.push_back(std::move(s));
+    }
+
+    return r;
+}
+
+
+/**********************************************************************************************/
+namespace detail {
+
+/**********************************************************************************************/
+// Objects of one dynamic type from a range, for 'for_each_pair'.
+//
+template<class B>
+struct pair_group final {
+    const arg_desc* desc_;
+    std::vector<B*> objects_;
+};
+
+/**********************************************************************************************/
+// An element of a range, or an object it points to (by a raw or a smart pointer).
+//
+template<class B, class E>
+B& pair_element(E& e) {
+    if constexpr(std::is_convertible_v<E&, B&>) {
+        return e;
+    } else {
+        return *e;
+    }
+}
+
+/**********************************************************************************************/
+// Splits objects of a range by dynamic types, in order of first occurrence.
+//
+template<class B, class R>
+std::vector<pair_group<B>> group_by_type(R& range, arg_descs_base& descs) {
+    std::vector<pair_group<B>> r;
+    std::size_t last = 0;
+
+    for(auto& e : range) {
+        B& v = pair_element<B>(e);
+        const std::type_info* type = &typeid(v);
+        const std::ptrdiff_t base_offset = reinterpret_cast<const char*>(&v) - static_cast<const char*>(dynamic_cast<const void*>(&v));
+
+        // Neighbours are often of the same type
+        if(last == r.size() || r[last].desc_->type_ != type || r[last].desc_->base_offset_ != base_offset) {
+            last = 0;
+            while(last < r.size() && (r[last].desc_->type_ != type || r[last].desc_->base_offset_ != base_offset)) {
+                ++last;
+            }
+            if(last == r.size()) {
+                r.push_back({ descs.get(const_cast<void*>(static_cast<const void*>(&v)), type, base_offset), {} });
+            }
+        }
+
+        r[last].objects_.push_back(&v);
+    }
+
+    return r;
+}
+
+/**********************************************************************************************/
+// Calls a multimethod for all pairs from two groups. Applicable implementations are found
+// once for the block, next ones are tried only after 'next_method'.
+//
+template<class M, class B1, class B2, class F>
+void call_block(const pair_group<B1>& g1, const pair_group<B2>& g2, F& on_result) {
+    using traits_t = typename M::proto_traits_t;
+    using ret_type_t = typename traits_t::ret_type;
+    using base1_t = typename traits_t::arg1_type;
+    using base2_t = typename traits_t::arg2_type;
+
+    const auto& data = M::data();
+    const std::uint64_t accepts = g1.desc_->accepts_ & g2.desc_->accepts_;
+
+    for(B1* p1 : g1.objects_) {
+        const arg<base1_t> a1(*p1, g1.desc_);
+
+        for(B2* p2 : g2.objects_) {
+            const arg<base2_t> a2(*p2, g2.desc_);
+
+            auto done = [&](auto& r) {
+                if constexpr(is_same_v<ret_type_t, void>) {
+                    on_result(*p1, *p2);
+                } else {
+                    on_result(*p1, *p2, method_result<ret_type_t>::unwrap(r));
+                }
+                return true;
+            };
+
+            bool called = false;
+            for(std::uint64_t chain = accepts ; chain && !called ; chain &= chain - 1) {
+                try {
+                    if(auto r = data.impls_[lowest_bit(chain)]->call(a1, a2)) {
+                        called = done(r);
+                    }
+                } catch(try_next&) {
+                }
+            }
+
+            if(called) {
+                continue;
+            }
+
+            if constexpr(is_same_v<ret_type_t, void>) {
+                dispatch_fallback<ret_type_t, base1_t>(data);
+                on_result(*p1, *p2);
+            } else {
+                on_result(*p1, *p2, dispatch_fallback<ret_type_t, base1_t>(data));
+            }
+        }
+    }
+}
+
+/**********************************************************************************************/
+} // namespace detail
+
+/**********************************************************************************************/
+// Calls a binary multimethod for each pair of objects from two ranges (cartesian product):
+//
+//   multimethods::for_each_pair(MM_METHOD(collide), asteroids, ships);
+//   multimethods::for_each_pair(MM_METHOD(overlap), shapes, shapes, [](shape& a, shape& b, bool r) {});
+//
+// Elements of ranges are objects, raw or smart pointers. Objects are grouped by dynamic types
+// and an implementation is selected once for each pair of types, so pairs are visited block by
+// block, not in order of ranges. 'on_result' gets both objects and a result of the call
+// (only objects for void multimethods).
+//
+template<class M, class R1, class R2, class F>
+void for_each_pair(const M& /*method*/, R1&& first, R2&& second, F&& on_result) {
+    using traits_t = typename M::proto_traits_t;
+    using base1_t = typename traits_t::arg1_type;
+    using base2_t = typename traits_t::arg2_type;
+    using B1 = std::remove_reference_t<base1_t>;
+    using B2 = std::remove_reference_t<base2_t>;
+
+    static_assert(traits_t::arity == 2, "for_each_pair needs a multimethod with two parameters.");
+    static_assert(std::is_reference_v<base1_t> && std::is_polymorphic_v<std::decay_t<B1>> &&
+                  std::is_reference_v<base2_t> && std::is_polymorphic_v<std::decay_t<B2>>,
+                  "for_each_pair needs references to polymorphic types as parameters.");
+    static_assert(!M::qualified(), "for_each_pair doesn't support before, after and around implementations.");
+
+    const auto& data = M::data();
+    const auto groups1 = detail::group_by_type<B1>(first, data.descs_[0]);
+    const auto groups2 = detail::group_by_type<B2>(second, data.descs_[1]);
+
+    for(auto& g1 : groups1) {
+        for(auto& g2 : groups2) {
+            detail::call_block<M>(g1, g2, on_result);
+        }
+    }
+}
+
+/**********************************************************************************************/
+template<class M, class R1, class R2>
+void for_each_pair(const M& method, R1&& first, R2&& second) {
+    for_each_pair(method, first, second, [](auto&&...) {});
+}
+
+
+/**********************************************************************************************/
+namespace detail {
+
+/**********************************************************************************************/
+// An argument bound to a descriptor resolved by a dispatch handle.
+//
+template<class B, class V>
+arg<B> bound_arg(V& v, const arg_desc* desc) {
+    if constexpr(is_polymorphic_v<decay_t<B>> || poly_pointer<B>() || tagged_class<decay_t<B>>()) {
+        return arg<B>(v, desc);
+    } else {
+        return arg<B>(v, false);
+    }
+}
+
+/**********************************************************************************************/
+// Parameter has descriptors of dynamic types of arguments.
+//
+template<class B>
+constexpr bool dynamic_param() {
+    using BD = decay_t<B>;
+    return is_polymorphic_v<BD> || poly_pointer<BD>() || tagged_class<BD>() || any_param<BD>();
+}
+
+/**********************************************************************************************/
+template<class A>
+const std::type_info* dynamic_type(A& v) {
+    using AD = decay_t<A>;
+
+    if constexpr(is_polymorphic_v<AD>) {
+        return &typeid(v);
+    } else if constexpr(poly_pointer<AD>()) {
+        const auto p = pointee_address(v);
+        return p ? &typeid(*p) : &typeid(std::nullptr_t);
+    } else if constexpr(any_param<AD>()) {
+        return &v.type();
+    } else if constexpr(tagged_class<AD>()) {
+        return tagged_type<AD>(typename sealed_classes<AD>::type(), mm_type_id(v));
+    } else {
+        return &typeid(AD);
+    }
+}
+
+/**********************************************************************************************/
+// Address of the most-derived object, 'nullptr' for non-polymorphic types.
+//
+template<class A>
+const char* dynamic_top(A& v) {
+    if constexpr(is_polymorphic_v<decay_t<A>>) {
+        return static_cast<const char*>(dynamic_cast<const void*>(&v));
+    } else if constexpr(poly_pointer<A>()) {
+        const auto p = pointee_address(v);
+        return p ? static_cast<const char*>(dynamic_cast<const void*>(p)) : nullptr;
+    } else {
+        return nullptr;
+    }
+}
+
+/**********************************************************************************************/
+// Descriptor of an argument's dynamic type, 'nullptr' for parameters without dynamic types.
+//
+template<class B>
+const arg_desc* resolve_arg(const arg<B>& a, arg_descs_base& descs, std::uint64_t& chain) {
+    chain &= a.resolve(descs);
+
+    if constexpr(dynamic_param<B>()) {
+        return a.desc_;
+    } else {
+        return nullptr;
+    }
+}
+
+template<class B, class V>
+const arg_desc* resolve_arg(V& v, arg_descs_base& descs, std::uint64_t& chain) {
+    return resolve_arg(arg<B>(v, true), descs, chain);
+}
+
+/**********************************************************************************************/
+// Arguments of a parameter are cast by fixed offsets: casts of pointers and 'std::any' depend
+// on values.
+//
+template<class B>
+constexpr bool fixed_offset() {
+    return !poly_pointer<decay_t<B>>() && !any_param<decay_t<B>>();
+}
+
+/**********************************************************************************************/
+// Address of an argument of a parameter's type, as casts of implementations take it.
+//
+template<class T>
+void* param_address(T& v) {
+    return const_cast<void*>(static_cast<const void*>(&v));
+}
+
+/**********************************************************************************************/
+// An argument has the dynamic type of a descriptor: the same class, class of the tag or type
+// of the value of 'std::any'.
+//
+template<class B, class V>
+bool same_type(V& v, const arg_desc* desc) {
+    if constexpr(dynamic_param<B>()) {
+        return *desc->type_ == *dynamic_type(v);
+    } else {
+        return true;
+    }
+}
+
+/**********************************************************************************************/
+} // namespace detail
+
+/**********************************************************************************************/
+// A multimethod with implementations already selected for dynamic types of arguments,
+// see 'resolve'. A call passes arguments at offsets found once directly to the first selected
+// implementation, 'next_method' goes to the next one without a lookup. Calls aren't traced or
+// profiled.
+//
+template<class M>
+class dispatch_handle final {
+    using traits_t   = typename M::proto_traits_t;
+    using ret_type_t = typename traits_t::ret_type;
+
+    template<std::size_t I>
+    using base_t = typename detail::nth_type<I,
+        typename traits_t::arg1_type, typename traits_t::arg2_type, typename traits_t::arg3_type,
+        typename traits_t::arg4_type, typename traits_t::arg5_type, typename traits_t::arg6_type>::type;
+
+    using impl_t = std::remove_pointer_t<std::decay_t<decltype(M::data().fallback_)>>;
+
+    template<std::size_t... I>
+    static constexpr bool fixed_offsets(std::index_sequence<I...>) {
+        return (... && detail::fixed_offset<base_t<I>>());
+    }
+
+    static constexpr bool direct = fixed_offsets(std::make_index_sequence<traits_t::arity>());
+
+public:
+    // Arguments are converted to parameters' types, as by ordinary calls.
+    template<std::size_t... I>
+    explicit dispatch_handle(std::index_sequence<I...>, base_t<I>... args) {
+        static_assert(!M::qualified(), "Handles don't support before, after and around implementations.");
+
+        const auto& data = M::data();
+        chain_ = detail::chain_between(0, static_cast<int>(data.impls_end_ - data.impls_));
+        ((descs_[I] = detail::resolve_arg<base_t<I>>(args, data.descs_[I], chain_)), ...);
+
+        if constexpr(direct) {
+            if(chain_) {
+                const auto impl = data.impls_[detail::lowest_bit(chain_)];
+                direct_ = impl->direct_;
+                ((offsets_[I] = static_cast<char*>(impl->casts_[I](detail::param_address(args))) - static_cast<char*>(detail::param_address(args))), ...);
+            }
+        }
+    }
+
+    // Calls the multimethod with arguments of the same dynamic types as ones it was resolved for.
+    template<class... A>
+    ret_type_t operator()(A&&... args) const {
+        static_assert(sizeof...(A) == traits_t::arity, "Wrong count of arguments.");
+        return call(std::index_sequence_for<A...>(), std::forward<A>(args)...);
+    }
+
+private:
+    std::uint64_t chain_;                             // Applicable implementations, by positions.
+    const detail::arg_desc* descs_[traits_t::arity];  // Dynamic types of arguments.
+    decltype(impl_t::direct_) direct_ { nullptr };    // Function of the first applicable implementation.
+    std::ptrdiff_t offsets_[traits_t::arity] {};      // Offsets of its parameters from arguments.
+
+    template<std::size_t... I>
+    ret_type_t call(std::index_sequence<I...>, base_t<I>... args) const {
+        const auto& data = M::data();
+
+#ifndef NDEBUG
+        if(!(detail::same_type<base_t<I>>(args, descs_[I]) && ...)) {
+            throw bad_handle((std::string(data.name_) + ": handle is called with arguments of other types.").c_str());
+        }
+#endif
+
+        std::uint64_t chain = chain_;
+
+        if constexpr(direct) {
+            if(direct_) {
+                void* const p[] = { static_cast<char*>(detail::param_address(args)) + offsets_[I]... };
+                try {
+                    return direct_(p);
+                } catch(detail::try_next&) {
+                }
+                chain &= chain - 1;
+            }
+        }
+
+        for( ; chain ; chain &= chain - 1) {
+            try {
+                if(auto r = data.impls_[detail::lowest_bit(chain)]->call(detail::bound_arg<base_t<I>>(args, descs_[I])...)) {
+                    return detail::method_result<ret_type_t>::unwrap(r);
+                }
+            } catch(detail::try_next&) {
+            }
+        }
+
+        return detail::dispatch_fallback<ret_type_t, base_t<0>>(data);
+    }
+};
+
+/**********************************************************************************************/
+// Selects implementations of a multimethod once for dynamic types of arguments, to call it
+// in a hot loop without dispatch:
+//
+//   auto h = multimethods::resolve(MM_METHOD(collide), a, s);
+//   for(...) h(a, s);
+//
+// The handle must be called only with arguments of the same dynamic types (checked if NDEBUG
+// is not defined) and resolved after 'load_dispatch_profile', which reorders implementations.
+//
+template<class M, class... A>
+dispatch_handle<M> resolve(const M& /*method*/, A&&... args) {
+    static_assert(sizeof...(A) == M::proto_traits_t::arity && sizeof...(A) > 0, "Wrong count of arguments.");
+    return dispatch_handle<M>(std::index_sequence_for<A...>(), std::forward<A>(args)...);
+}
+
+/**********************************************************************************************/
+// A multimethod with leading arguments bound, see 'partial'. Implementations that accept the
+// bound arguments are selected once, a call finds descriptors of the remaining arguments only
+// and tries implementations from both sets. Calls aren't traced or profiled.
+//
+template<class M, class... A>
+class partial_method final {
+    using traits_t   = typename M::proto_traits_t;
+    using ret_type_t = typename traits_t::ret_type;
+
+    static constexpr std::size_t bound_count = sizeof...(A);
+    static constexpr std::size_t rest_count  = traits_t::arity - bound_count;
+
+    template<std::size_t I>
+    using base_t = typename detail::nth_type<I,
+        typename traits_t::arg1_type, typename traits_t::arg2_type, typename traits_t::arg3_type,
+        typename traits_t::arg4_type, typename traits_t::arg5_type, typename traits_t::arg6_type>::type;
+
+public:
+    // Arguments are bound by references or copied, see 'bound_t'.
+    template<std::size_t... I>
+    partial_method(std::index_sequence<I...>, A&... args)
+    : bound_(args...) {
+        static_assert(!M::qualified(), "Bound methods don't support before, after and around implementations.");
+
+        const auto& data = M::data();
+        chain_ = detail::chain_between(0, static_cast<int>(data.impls_end_ - data.impls_));
+        ((descs_[I] = detail::resolve_arg<base_t<I>>(std::get<I>(bound_), data.descs_[I], chain_)), ...);
+    }
+
+    // False if no implementation accepts the bound arguments, so only the fallback may be called.
+    explicit operator bool() const { return chain_ != 0; }
+
+    // Calls the multimethod with the bound arguments followed by 'args'.
+    template<class... R>
+    ret_type_t operator()(R&&... args) const {
+        static_assert(sizeof...(R) == rest_count, "Wrong count of arguments.");
+        return call(std::index_sequence_for<A...>(), std::index_sequence_for<R...>(), std::forward<R>(args)...);
+    }
+
+private:
+    // Bound argument 'T': a reference if a reference parameter binds to it, otherwise a copy
+    // converted to the parameter's type.
+    template<std::size_t I, class T, class BD = std::decay_t<base_t<I>>>
+    using bound_t = std::conditional_t<std::is_reference_v<base_t<I>> &&
+                                           (std::is_same_v<std::decay_t<T>, BD> || std::is_base_of_v<BD, std::decay_t<T>>),
+                                       std::remove_reference_t<base_t<I>>&, BD>;
+
+    template<std::size_t... I>
+    static std::tuple<bound_t<I, A>...> bound_tuple(std::index_sequence<I...>);
+
+    mutable decltype(bound_tuple(std::index_sequence_for<A...>())) bound_; // Bound arguments.
+    std::uint64_t chain_;                              // Implementations that accept them, by positions.
+    const detail::arg_desc* descs_[bound_count];       // Dynamic types of bound arguments.
+
+    template<std::size_t... I, std::size_t... J>
+    ret_type_t call(std::index_sequence<I...>, std::index_sequence<J...>, base_t<bound_count + J>... args) const {
+        const auto& data = M::data();
+
+        std::uint64_t chain = chain_;
+        const detail::arg_desc* descs[rest_count];
+        ((descs[J] = detail::resolve_arg<base_t<bound_count + J>>(args, data.descs_[bound_count + J], chain)), ...);
+
+        for( ; chain ; chain &= chain - 1) {
+            try {
+                if(auto r = data.impls_[detail::lowest_bit(chain)]->call(
+                        detail::bound_arg<base_t<I>>(std::get<I>(bound_), descs_[I])...,
+                        detail::bound_arg<base_t<bound_count + J>>(args, descs[J])...)) {
+                    return detail::method_result<ret_type_t>::unwrap(r);
+                }
+            } catch(detail::try_next&) {
+            }
+        }
+
+        return detail::dispatch_fallback<ret_type_t, base_t<0>>(data);
+    }
+};
+
+/**********************************************************************************************/
+// Binds leading arguments of a multimethod, their dynamic types are found once and later calls
+// dispatch only by the remaining arguments:
+//
+//   auto d = multimethods::partial(MM_METHOD(draw), device);
+//   for(auto& s : shapes) d(*s);
+//
+// Bound objects must outlive the result (arguments converted to types of value parameters are
+// copied), it must be created after 'load_dispatch_profile',
+// which reorders implementations.
+//
+template<class M, class... A>
+partial_method<M, A...> partial(const M& /*method*/, A&... args) {
+    static_assert(sizeof...(A) > 0 && sizeof...(A) < M::proto_traits_t::arity, "Wrong count of arguments.");
+    return partial_method<M, A...>(std::index_sequence_for<A...>(), args...);
+}
+
+/**********************************************************************************************/
+// Implementations of a multimethod, selected by tags of classes of dispatched arguments before
+// objects exist, see 'route'. A call goes straight to the nested switch of the sealed
+// hierarchies with known indexes of classes. Calls aren't traced or profiled.
+//
+template<class M>
+class tag_route final {
+    using traits_t   = typename M::proto_traits_t;
+    using ret_type_t = typename traits_t::ret_type;
+    using sealed_t   = typename M::template sealed_t<>;
+
+    static constexpr unsigned mask = M::dispatched_mask();
+
+    template<std::size_t I>
+    using base_t = typename detail::nth_type<I,
+        typename traits_t::arg1_type, typename traits_t::arg2_type, typename traits_t::arg3_type,
+        typename traits_t::arg4_type, typename traits_t::arg5_type, typename traits_t::arg6_type>::type;
+
+    template<std::size_t I>
+    using classes_t = typename detail::sealed_classes<std::decay_t<base_t<I>>>::type;
+
+public:
+    template<class... T>
+    explicit tag_route(T... tags) {
+        static_assert(sealed_t::enabled, "Routes need methods dispatched only by sealed hierarchies, "
+            "without before, after and around implementations.");
+        static_assert(sizeof...(T) == detail::bits_count(mask), "One tag for each dispatched parameter.");
+
+        const long long values[] = { static_cast<long long>(tags)... };
+        known_ = init(std::make_index_sequence<traits_t::arity>(), values);
+        impl_ = known_ ? sealed_t::template visit<detail::sealed_first>(indexes_) : -1;
+    }
+
+    // Some implementation (not the fallback) accepts objects of the classes with these tags.
+    explicit operator bool() const { return impl_ >= 0; }
+
+    // Index of the first accepting implementation in order of dispatching (as in traces), or -1.
+    int impl() const { return impl_; }
+
+    // Calls 'f' with a null pointer to the class of the argument 'I' (C*), to build the object
+    // straight from a payload. Nothing is called for unknown tags.
+    template<std::size_t I, class F>
+    void with_class(F&& f) const {
+        static_assert(mask & (1u << I), "Parameter isn't dispatched.");
+        detail::sealed_class_at(classes_t<I>(), indexes_[I], f);
+    }
+
+    // Calls the multimethod with objects of the classes of the tags, without dispatching (checked
+    // if NDEBUG is not defined). Objects with unknown tags are dispatched as usual.
+    template<class... A>
+    ret_type_t operator()(A&&... args) const {
+        static_assert(sizeof...(A) == traits_t::arity, "Wrong count of arguments.");
+        return call(std::index_sequence_for<A...>(), std::forward<A>(args)...);
+    }
+
+private:
+    int indexes_[traits_t::arity > 0 ? traits_t::arity : 1] {}; // Indexes of classes in their sealed hierarchies.
+    int impl_ = -1;
+    bool known_ = false;
+
+    template<std::size_t... I>
+    bool init(std::index_sequence<I...>, const long long* tags) {
+        int tag = 0;
+        ((indexes_[I] = class_index<I>(tags, tag)), ...);
+        return std::find(indexes_, indexes_ + traits_t::arity, -1) == indexes_ + traits_t::arity;
+    }
+
+    template<std::size_t I>
+    static int class_index(const long long* tags, int& tag) {
+        if constexpr(mask & (1u << I)) {
+            return detail::tagged_index(classes_t<I>(), tags[tag++]);
+        } else {
+            return 0;
+        }
+    }
+
+    // An argument is of the class of its tag (or isn't dispatched).
+    template<std::size_t I, class A>
+    bool routed_class(A& a) const {
+        if constexpr(mask & (1u << I)) {
+            return detail::sealed_index(a) == indexes_[I];
+        } else {
+            return true;
+        }
+    }
+
+    template<std::size_t... I>
+    ret_type_t call(std::index_sequence<I...>, base_t<I>... args) const {
+        if(!known_) {
+            return M()(static_cast<base_t<I>>(args)...);
+        }
+
+#ifndef NDEBUG
+        if(!(routed_class<I>(args) && ...)) {
+            throw bad_handle((std::string(M::data().name_) + ": route is called with objects of other classes.").c_str());
+        }
+#endif
+
+        if(auto r = sealed_t::template visit<detail::sealed_calls<ret_type_t>>(indexes_, args...)) {
+            return detail::method_result<ret_type_t>::unwrap(r);
+        }
+        detail::throw_method_not_implemented(M::data().name_);
+    }
 };
 
 /**********************************************************************************************/
-template<class R, class T1>
-struct function_traits_impl<R(*)(T1)> {
-    enum { arity = 1 };
-    using ret_type = R;
-    using arg1_type = T1;
-    using arg2_type = none_t;
-    using arg3_type = none_t;
-    using arg4_type = none_t;
-    using arg5_type = none_t;
-    using arg6_type = none_t;
-};
+// Selects implementations of a multimethod by tags of classes (MM_TYPE_ID) of dispatched
+// arguments, one tag for each dispatched parameter, before objects are built. All dispatched
+// parameters must be references to sealed hierarchies (MM_SEALED):
+//
+//   auto r = multimethods::route(MM_METHOD(handle), header.kind);
+//   if(!r) return;                             // Dropped without decoding
+//   r.with_class<0>([&](auto* type) {
+//       auto m = decode<std::remove_pointer_t<decltype(type)>>(payload);
+//       r(m);                                  // No dispatch
+//   });
+//
+template<class M, class... T>
+tag_route<M> route(const M& /*method*/, T... tags) {
+    return tag_route<M>(tags...);
+}
+
+
+/**********************************************************************************************/
+namespace detail {
 
 /**********************************************************************************************/
-template<class R, class T1, class T2>
-struct function_traits_impl<R(*)(T1, T2)> {
-    enum { arity = 2 };
-    using ret_type = R;
-    using arg1_type = T1;
-    using arg2_type = T2;
-    using arg3_type = none_t;
-    using arg4_type = none_t;
-    using arg5_type = none_t;
-    using arg6_type = none_t;
-};
+template<class T, std::size_t I>
+using param_base_t = typename nth_type<I,
+    typename T::arg1_type, typename T::arg2_type, typename T::arg3_type,
+    typename T::arg4_type, typename T::arg5_type, typename T::arg6_type>::type;
+
+} // namespace detail
 
 /**********************************************************************************************/
-template<class R, class T1, class T2, class T3>
-struct function_traits_impl<R(*)(T1, T2, T3)> {
-    enum { arity = 3 };
-    using ret_type = R;
-    using arg1_type = T1;
-    using arg2_type = T2;
-    using arg3_type = T3;
-    using arg4_type = none_t;
-    using arg5_type = none_t;
-    using arg6_type = none_t;
+// Arguments with dynamic types found once, for several multimethods called with the same
+// objects:
+//
+//   multimethods::dispatch_context ctx(a, b);
+//   collide(ctx);
+//   resolve_damage(ctx);
+//
+// A multimethod takes the context if its parameters are bases of the context's types. Its
+// first call selects implementations and casts of arguments without identifying their types
+// again, and stores them in the context (for the last 'cached_methods' multimethods), so later
+// calls with the context pass arguments directly, as a 'dispatch_handle' does. Objects must
+// outlive the context, which must be created after 'load_dispatch_profile'.
+//
+template<class... A>
+class dispatch_context final {
+    static_assert(sizeof...(A) > 0, "Dispatch context needs arguments.");
+
+public:
+    static constexpr std::size_t cached_methods = 4;
+
+    // Implementations of a multimethod selected for the arguments.
+    struct resolved_method final {
+        int method_ { -1 };                             // Id of the multimethod.
+        std::uint64_t chain_ { 0 };                     // Applicable implementations, by positions.
+        const detail::arg_desc* descs_[sizeof...(A)];   // Dynamic types of arguments.
+        void (*direct_)() { nullptr };                  // Function of the first applicable implementation.
+        std::ptrdiff_t offsets_[sizeof...(A)];          // Offsets of its parameters from arguments.
+    };
+
+    explicit dispatch_context(A&... args)
+    : args_ { &args... },
+      types_ { detail::dynamic_type(args)... },
+      tops_ { detail::dynamic_top(args)... } {
+    }
+
+    template<std::size_t I>
+    auto& get() const { return *std::get<I>(args_); }
+
+    const std::type_info* type(std::size_t i) const { return types_[i]; }
+    const char* top(std::size_t i) const { return tops_[i]; }
+
+    // Ordinary call with the same arguments.
+    template<class F>
+    decltype(auto) apply(const F& f) const {
+        return std::apply([&f](A*... p) -> decltype(auto) { return f(*p...); }, args_);
+    }
+
+    // Entry of a multimethod, or the oldest entry to replace if it isn't there.
+    resolved_method& resolved(int method) const {
+        for(auto& r : resolved_) {
+            if(r.method_ == method) {
+                return r;
+            }
+        }
+        return resolved_[next_++ % cached_methods];
+    }
+
+private:
+    std::tuple<A*...> args_;
+    const std::type_info* types_[sizeof...(A)]; // Dynamic types of arguments.
+    const char* tops_[sizeof...(A)];            // Most-derived objects of polymorphic arguments.
+    mutable resolved_method resolved_[cached_methods];
+    mutable unsigned next_ { 0 };
 };
 
 /**********************************************************************************************/
-template<class R, class T1, class T2, class T3, class T4>
-struct function_traits_impl<R(*)(T1, T2, T3, T4)> {
-    enum { arity = 4 };
-    using ret_type = R;
-    using arg1_type = T1;
-    using arg2_type = T2;
-    using arg3_type = T3;
-    using arg4_type = T4;
-    using arg5_type = none_t;
-    using arg6_type = none_t;
-};
+namespace detail {
 
-template<class R, class T1, class T2, class T3, class T4, class T5>
-struct function_traits_impl<R(*)(T1, T2, T3, T4, T5)> {
-    enum { arity = 5 };
-    using ret_type = R;
-    using arg1_type = T1;
-    using arg2_type = T2;
-    using arg3_type = T3;
-    using arg4_type = T4;
-    using arg5_type = T5;
-    using arg6_type = none_t;
-};
+/**********************************************************************************************/
+template<class M, auto& cache, class... T>
+typename M::proto_traits_t::ret_type context_dispatch(const typename decay_t<decltype(cache)>::key_t& key, const T&... args) {
+    using ret_type_t = typename M::proto_traits_t::ret_type;
+
+    const auto& data = M::data();
+    const int count = static_cast<int>(data.impls_end_ - data.impls_);
+
+    int start = cache.find(key);
+    if(start < 0) {
+        std::uint64_t chain = chain_between(0, count);
+        int i = 0;
+        ((chain &= args.resolve(data.descs_[i++])), ...);
+        start = cache.insert(key, chain);
+    }
 
-template<class R, class T1, class T2, class T3, class T4, class T5, class T6>
-struct function_traits_impl<R(*)(T1, T2, T3, T4, T5, T6)> {
-    enum { arity = 6 };
-    using ret_type = R;
-    using arg1_type = T1;
-    using arg2_type = T2;
-    using arg3_type = T3;
-    using arg4_type = T4;
-    using arg5_type = T5;
-    using arg6_type = T6;
-};
+    for(auto m = data.impls_ + start ; m < data.impls_end_ ; ++m) {
+        try {
+            if(auto r = (*m)->call(args...)) {
+                return method_result<ret_type_t>::unwrap(r);
+            }
+        } catch(try_next&) {
+            const std::uint64_t rest = cache.next(key, static_cast<int>(m - data.impls_));
+            m = data.impls_ + (rest ? lowest_bit(rest) : count) - 1;
+        }
+    }
+
+    return dispatch_fallback<ret_type_t, param_base_t<typename M::proto_traits_t, 0>>(data);
+}
 
 /**********************************************************************************************/
-template<class F>
-struct function_traits : public function_traits_impl<F> {
+// Calls a multimethod with arguments of a dispatch context converted to its parameters' types,
+// selects implementations on the first call with the context.
+//
+template<class M, class... A, std::size_t... I>
+typename M::proto_traits_t::ret_type context_resolved_call(const dispatch_context<A...>& ctx, std::index_sequence<I...>,
+                                                           param_base_t<typename M::proto_traits_t, I>... args) {
+    using traits_t   = typename M::proto_traits_t;
+    using ret_type_t = typename traits_t::ret_type;
+    using impl_t     = std::remove_pointer_t<decay_t<decltype(M::data().fallback_)>>;
+
+    constexpr bool direct = (... && fixed_offset<param_base_t<traits_t, I>>());
+
+    const auto& data = M::data();
+    auto& r = ctx.resolved(data.info_.id_);
+
+    if(r.method_ != data.info_.id_) {
+        r.chain_ = chain_between(0, static_cast<int>(data.impls_end_ - data.impls_));
+        ((r.descs_[I] = resolve_arg(arg<param_base_t<traits_t, I>>(ctx.template get<I>(), ctx.type(I), ctx.top(I)), data.descs_[I], r.chain_)), ...);
+        r.direct_ = nullptr;
+
+        if constexpr(direct) {
+            if(r.chain_) {
+                // Descriptors already have casts of arguments with dynamic types
+                const int pos = lowest_bit(r.chain_);
+                const auto impl = data.impls_[pos];
+                r.direct_ = reinterpret_cast<void (*)()>(impl->direct_);
+                ((r.offsets_[I] = r.descs_[I] ? r.descs_[I]->offsets_[pos] - r.descs_[I]->base_offset_
+                                              : static_cast<char*>(impl->casts_[I](param_address(args))) - static_cast<char*>(param_address(args))), ...);
+            }
+        }
+
+        r.method_ = data.info_.id_;
+    }
+
+    std::uint64_t chain = r.chain_;
+
+    if constexpr(direct) {
+        if(r.direct_) {
+            void* const p[] = { static_cast<char*>(param_address(args)) + r.offsets_[I]... };
+            try {
+                return reinterpret_cast<decltype(impl_t::direct_)>(r.direct_)(p);
+            } catch(try_next&) {
+            }
+            chain &= chain - 1;
+        }
+    }
+
+    for( ; chain ; chain &= chain - 1) {
+        try {
+            if(auto res = data.impls_[lowest_bit(chain)]->call(bound_arg<param_base_t<traits_t, I>>(args, r.descs_[I])...)) {
+                return method_result<ret_type_t>::unwrap(res);
+            }
+        } catch(try_next&) {
+        }
+    }
+
+    return dispatch_fallback<ret_type_t, param_base_t<traits_t, 0>>(data);
+}
+
+/**********************************************************************************************/
+// Calls a multimethod with arguments of a dispatch context. Traced and profiled calls are
+// ordinary ones.
+//
+template<class M, class... A, std::size_t... I>
+typename M::proto_traits_t::ret_type context_call(const dispatch_context<A...>& ctx, std::index_sequence<I...> seq) {
+    static_assert(sizeof...(A) == M::proto_traits_t::arity, "Wrong count of arguments.");
+
+#if defined(MM_ENABLE_TRACE) || defined(MM_ENABLE_PROFILE)
+    return ctx.apply(M());
+#else
+    return context_resolved_call<M>(ctx, seq, ctx.template get<I>()...);
+#endif
+}
+
+
+/**********************************************************************************************/
+// Continuation of a running 'match_around' implementation, see 'call_next_method'.
+//
+template<class R>
+struct next_around {
+    virtual R proceed() const = 0;
 };
 
+/**********************************************************************************************/
+inline const void*& current_next_around() {
+    static thread_local const void* next = nullptr;
+    return next;
+}
 
 /**********************************************************************************************/
-#define MM_CAST_1 if(auto u1 = p1.template cast<typename function_traits<F>::arg1_type>())
-#define MM_CAST_2 MM_CAST_1 if(auto u2 = p2.template cast<typename function_traits<F>::arg2_type>())
-#define MM_CAST_3 MM_CAST_2 if(auto u3 = p3.template cast<typename function_traits<F>::arg3_type>())
-#define MM_CAST_4 MM_CAST_3 if(auto u4 = p4.template cast<typename function_traits<F>::arg4_type>())
-#define MM_CAST_5 MM_CAST_4 if(auto u5 = p5.template cast<typename function_traits<F>::arg5_type>())
-#define MM_CAST_6 MM_CAST_5 if(auto u6 = p6.template cast<typename function_traits<F>::arg6_type>())
+template<class R>
+R call_next_around() {
+    const auto next = static_cast<const next_around<R>*>(current_next_around());
+    if(!next) {
+        throw not_implemented("call_next_method: called outside of match_around.");
+    }
+
+    return next->proceed();
+}
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_0 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
-    const F f_;
-    constexpr explicit method_0(F f) : f_(f) {}
+// Sets the continuation for 'call_next_method' and restores the previous one.
+//
+class next_around_scope final {
+public:
+    explicit next_around_scope(const void* next)
+    : saved_(current_next_around()) {
+        current_next_around() = next;
+    }
+
+    ~next_around_scope() { current_next_around() = saved_; }
+
+    next_around_scope(const next_around_scope&) = delete;
+    next_around_scope& operator=(const next_around_scope&) = delete;
 
-    ret_t call() { return ret_t { f_() }; }
+private:
+    const void* const saved_;
 };
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_0_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    const F f_;
-    constexpr explicit method_0_void(F f) : f_(f) {}
+template<class B> void* arg_address(const arg_poly<B>& a) { return const_cast<void*>(static_cast<const void*>(a.base_)); }
+template<class B> void* arg_address(const arg_tagged<B>& a) { return const_cast<void*>(static_cast<const void*>(a.base_)); }
+template<class B> void* arg_address(const arg_non_poly<B>& a) { return const_cast<void*>(static_cast<const void*>(a.p_)); }
 
-    bool call() { f_(); return true; }
-};
+/**********************************************************************************************/
+// Bit mask of qualified implementations that accept arguments: hooks by their positions,
+// then around implementations.
+//
+template<class Q, class... T>
+std::uint64_t applicable_qualified(const T&... args) {
+    void* const p[] = { arg_address(args)... };
+    const auto accepts = [&p](const auto* impl) {
+        for(std::size_t i = 0 ; i < sizeof...(T) ; ++i) {
+            if(!impl->casts_[i](p[i])) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::uint64_t r = 0;
+    for(int i = 0 ; i < Q::befores + Q::afters ; ++i) {
+        if(accepts(Q::hooks_[i])) {
+            r |= std::uint64_t(1) << i;
+        }
+    }
+    for(int i = 0 ; i < Q::arounds ; ++i) {
+        if(accepts(Q::arounds_[i])) {
+            r |= std::uint64_t(1) << (Q::befores + Q::afters + i);
+        }
+    }
+    return r;
+}
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_1 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
-    const F f_;
-    constexpr explicit method_1(F f) : f_(f) {}
+// Applicable qualified implementations of a call with its arguments. Runs around ones, then
+// before ones, the primary implementation and after ones.
+//
+template<class Q, class M, auto& cache, class... T>
+class combination final {
+public:
+    using ret_t = typename M::proto_traits_t::ret_type;
+    using key_t = typename decay_t<decltype(cache)>::key_t;
+
+    static constexpr int first_around = Q::befores + Q::afters;
+
+    combination(const key_t& key, std::uint64_t applicable, const T&... args)
+    : key_(key),
+      applicable_(applicable),
+      args_(args...) {
+    }
 
-    constexpr ret_t call(arg<B1> p1) {
-        MM_CAST_1 return ret_t { f_(*u1) };
-        return {};
+    // Runs around implementations from 'arounds', the most specific first.
+    ret_t run(std::uint64_t arounds) const {
+        for( ; arounds ; arounds &= arounds - 1) {
+            const continuation next(*this, arounds & (arounds - 1));
+            const next_around_scope scope(static_cast<const next_around<ret_t>*>(&next));
+
+            try {
+                const int i = lowest_bit(arounds) - first_around;
+                if(auto r = std::apply([i](const T&... a) { return Q::arounds_[i]->call(a...); }, args_)) {
+                    return method_result<ret_t>::unwrap(r);
+                }
+            } catch(try_next&) {
+            }
+        }
+
+        return core();
+    }
+
+    std::uint64_t arounds() const { return applicable_ & chain_between(first_around, first_around + Q::arounds); }
+
+private:
+    struct continuation final : next_around<ret_t> {
+        const combination& c_;
+        const std::uint64_t arounds_;
+
+        continuation(const combination& c, std::uint64_t arounds) : c_(c), arounds_(arounds) {}
+        ret_t proceed() const final { return c_.run(arounds_); }
+    };
+
+    void hooks(std::uint64_t mask) const {
+        for(mask &= applicable_ ; mask ; mask &= mask - 1) {
+            try {
+                const int i = lowest_bit(mask);
+                std::apply([i](const T&... a) { Q::hooks_[i]->call(a...); }, args_);
+            } catch(try_next&) {
+            }
+        }
+    }
+
+    // Primary implementations get copies of arguments, their descriptors don't fit hooks.
+    ret_t primary() const {
+        return std::apply([this](const T&... a) { return context_dispatch<M, cache>(key_, T(a)...); }, args_);
+    }
+
+    ret_t core() const {
+        const next_around_scope scope(nullptr);
+
+        hooks(chain_between(0, Q::befores));
+        if constexpr(is_same_v<ret_t, void>) {
+            primary();
+            hooks(chain_between(Q::befores, first_around));
+        } else {
+            ret_t r = primary();
+            hooks(chain_between(Q::befores, first_around));
+            return std::forward<ret_t>(r);
+        }
     }
 
-    virtual bool is_fallback() const { return is_same_v<fallback_t, typename function_traits<F>::arg1_type>; }
+    const key_t& key_;
+    const std::uint64_t applicable_;
+    const std::tuple<const T&...> args_;
 };
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_1_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    const F f_;
-    constexpr explicit method_1_void(F f) : f_(f) {}
+template<class Q, class M, auto& cache, unsigned mask, std::size_t... I, class... T>
+typename M::proto_traits_t::ret_type run_combination(std::index_sequence<I...>, const T&... args) {
+    using cache_t = decay_t<decltype(cache)>;
+    static cache_t applicable; // Masks of qualified implementations by types of arguments
+
+    const typename cache_t::key_t key { { (mask & (1u << I) ? args.type() : nullptr)... } };
+
+    std::uint64_t qualified;
+    if(applicable.find(key) >= 0) {
+        qualified = applicable.next(key, -1);
+    } else {
+        qualified = applicable_qualified<Q>(args...);
+        applicable.insert(key, qualified);
+    }
 
-    constexpr bool call(arg<B1> p1) {
-        MM_CAST_1 { f_(*u1); return true; }
-        return false;
+    const combination<Q, M, cache, T...> c(key, qualified, args...);
+    return c.run(c.arounds());
+}
+
+/**********************************************************************************************/
+// Calls a multimethod that has before, after or around implementations.
+//
+template<class Q, class M, auto& cache, unsigned mask, std::size_t... I, class... A>
+typename M::proto_traits_t::ret_type qualified_call(std::index_sequence<I...> seq, A&... p) {
+    using traits_t = typename M::proto_traits_t;
+    return run_combination<Q, M, cache, mask>(seq, arg<param_base_t<traits_t, I>>(p, bool(mask & (1u << I)))...);
+}
+
+} // namespace detail
+
+
+/**********************************************************************************************/
+// Objects of classes derived from 'B', stored by value in contiguous segments, one segment
+// per dynamic type. Types are known when objects are added, so iteration never identifies
+// them, and algorithms can dispatch once per segment (see 'for_each'):
+//
+//   multimethods::poly_vector<thing> objects;
+//   objects.emplace_back<asteroid>(...);
+//   multimethods::for_each(MM_METHOD(update), objects, dt);
+//
+// Objects are visited segment by segment (in order of first insertion of their types), not in
+// order of insertion. Adding objects may move objects of the same type.
+//
+template<class B>
+class poly_vector final {
+public:
+    // Objects of one dynamic type.
+    class segment {
+    public:
+        virtual ~segment() = default;
+
+        const std::type_info& type() const { return *type_; }
+        std::size_t size() const { return size_; }
+
+        B& operator[](std::size_t i) {
+            return *reinterpret_cast<B*>(data_ + i * stride_ + offset_);
+        }
+
+        const B& operator[](std::size_t i) const {
+            return *reinterpret_cast<const B*>(data_ + i * stride_ + offset_);
+        }
+
+    protected:
+        segment(const std::type_info& type, std::size_t stride) : type_(&type), stride_(stride) {}
+
+        const std::type_info* const type_;
+        const std::size_t stride_;
+        std::ptrdiff_t offset_ { 0 }; // From an object to its 'B' base.
+        char* data_ { nullptr };
+        std::size_t size_ { 0 };
+
+        friend class poly_vector;
+    };
+
+    // Adds an object of the exact type 'T'.
+    template<class T, class... A>
+    T& emplace_back(A&&... args) {
+        static_assert(std::is_base_of_v<B, T>, "Objects must be derived from the base class.");
+
+        auto& s = find<T>();
+        T& r = s.objects_.emplace_back(std::forward<A>(args)...);
+        s.offset_ = reinterpret_cast<char*>(static_cast<B*>(&r)) - reinterpret_cast<char*>(&r);
+        s.data_ = reinterpret_cast<char*>(s.objects_.data());
+        s.size_ = s.objects_.size();
+        ++size_;
+        return r;
+    }
+
+    template<class T>
+    std::decay_t<T>& push_back(T&& v) {
+        return emplace_back<std::decay_t<T>>(std::forward<T>(v));
+    }
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    void clear() {
+        segments_.clear();
+        size_ = 0;
+    }
+
+    // Segments keep the constness of the container.
+    std::size_t segment_count() const { return segments_.size(); }
+    segment& segment_at(std::size_t i) { return *segments_[i]; }
+    const segment& segment_at(std::size_t i) const { return *segments_[i]; }
+
+    // Calls 'f' for each object, segment by segment.
+    template<class F>
+    void for_each(F&& f) {
+        for(auto& s : segments_) {
+            for(std::size_t i = 0 ; i < s->size_ ; ++i) {
+                f((*s)[i]);
+            }
+        }
+    }
+
+    template<class F>
+    void for_each(F&& f) const {
+        for(auto& s : segments_) {
+            const segment& cs = *s;
+            for(std::size_t i = 0 ; i < cs.size_ ; ++i) {
+                f(cs[i]);
+            }
+        }
     }
 
-    virtual bool is_fallback() const { return is_same_v<fallback_t, typename function_traits<F>::arg1_type>; }
+private:
+    template<class T>
+    struct typed_segment final : segment {
+        typed_segment() : segment(typeid(T), sizeof(T)) {}
+        std::vector<T> objects_;
+    };
+
+    std::vector<std::unique_ptr<segment>> segments_;
+    std::size_t size_ { 0 };
+
+    template<class T>
+    typed_segment<T>& find() {
+        for(auto& s : segments_) {
+            if(s->type_ == &typeid(T)) {
+                return static_cast<typed_segment<T>&>(*s);
+            }
+        }
+
+        segments_.push_back(std::make_unique<typed_segment<T>>());
+        return static_cast<typed_segment<T>&>(*segments_.back());
+    }
 };
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_2 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
-    const F f_;
-    constexpr explicit method_2(F f) : f_(f) {}
+namespace detail {
 
-    constexpr ret_t call(arg<B1> p1, arg<B2> p2) {
-        MM_CAST_2 return ret_t { f_(*u1, *u2) };
-        return {};
+template<class V> struct is_poly_vector : std::false_type {};
+template<class B> struct is_poly_vector<poly_vector<B>> : std::true_type {};
+
+} // namespace detail
+
+/**********************************************************************************************/
+// Calls a multimethod for each object of a 'poly_vector', with the same other arguments:
+//
+//   multimethods::for_each(MM_METHOD(update), objects, dt);
+//
+// Implementations are selected once per segment, like 'resolve' does, then are called for all
+// objects of the segment. Results are ignored. Objects of a const container are passed as const,
+// so a method with a non-const first parameter needs a non-const container.
+//
+template<class M, class V, class... A>
+std::enable_if_t<detail::is_poly_vector<std::remove_const_t<V>>::value>
+for_each(const M& method, V& objects, A&&... args) {
+    static_assert(M::proto_traits_t::arity == sizeof...(A) + 1, "Wrong count of arguments.");
+    static_assert(!std::is_const_v<V> || std::is_const_v<std::remove_reference_t<detail::param_base_t<typename M::proto_traits_t, 0>>>,
+        "Objects of a const container can't be passed to a non-const parameter.");
+
+    for(std::size_t k = 0, c = objects.segment_count() ; k < c ; ++k) {
+        auto& s = objects.segment_at(k);
+        if(s.size() == 0) {
+            continue;
+        }
+
+        const auto h = resolve(method, s[0], args...);
+        for(std::size_t i = 0, n = s.size() ; i < n ; ++i) {
+            h(s[i], args...);
+        }
     }
+}
+
+
+#ifdef MM_ENABLE_TRACE
+
+/**********************************************************************************************/
+// A record about one call of a multimethod.
+//
+struct trace_record final {
+    enum flags_t : std::uint8_t {
+        used_fallback = 1 // Fallback handler was called.
+    };
+
+    std::uint64_t time_;               // Timestamp of the call (TSC ticks or steady_clock).
+    const std::type_info* types_[6];   // Dynamic types of first 'arity_' arguments.
+    std::uint16_t method_;             // Id of a multimethod (see 'method_name').
+    std::int8_t impl_;                 // Index of the selected implementation or -1.
+    std::uint8_t arity_;               // Count of arguments.
+    std::uint8_t probes_;              // Count of tried implementations.
+    std::uint8_t next_;                // Count of 'next_method' calls.
+    std::uint8_t flags_;               // Combination of 'flags_t'.
 };
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_2_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    const F f_;
-    constexpr explicit method_2_void(F f) : f_(f) {}
+namespace detail {
+
+/**********************************************************************************************/
+// Per-thread ring buffer with trace records. The owner thread is the only writer. Each slot
+// is a seqlock: records are copied by atomic words between changes of the slot's stamp, and
+// readers (drain_trace) skip records whose stamps changed while they were copied.
+//
+struct trace_buffer final {
+    static constexpr std::uint64_t size = 4096;
+    static constexpr std::size_t words = sizeof(trace_record) / sizeof(std::uint64_t);
+
+    static_assert(sizeof(trace_record) % sizeof(std::uint64_t) == 0 && std::is_trivially_copyable_v<trace_record>,
+        "Trace records are copied by 64-bit words.");
+
+    struct slot final {
+        std::atomic<std::uint64_t> stamp_ { 0 }; // 2 * n + 1 while record n is written, 2 * n + 2 after.
+        std::atomic<std::uint64_t> words_[words];
+    };
+
+    std::atomic<std::uint64_t> head_ { 0 };
+    std::atomic<bool> used_ { true };   // Owner thread is alive.
+    std::uint64_t tail_ { 0 };          // Guarded by 'registry_mutex'.
+    slot slots_[size];
+
+    void push(const trace_record& r) {
+        const std::uint64_t h = head_.load(std::memory_order_relaxed);
+        slot& s = slots_[h & (size - 1)];
+
+        std::uint64_t w[words];
+        std::memcpy(w, &r, sizeof(r));
+
+        s.stamp_.store(2 * h + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(std::size_t i = 0 ; i < words ; ++i) {
+            s.words_[i].store(w[i], std::memory_order_relaxed);
+        }
+        s.stamp_.store(2 * h + 2, std::memory_order_release);
+
+        head_.store(h + 1, std::memory_order_release);
+    }
+
+    // Copies record 'n' if it is still in its slot.
+    bool read(std::uint64_t n, trace_record& r) const {
+        const slot& s = slots_[n & (size - 1)];
+
+        const std::uint64_t stamp = s.stamp_.load(std::memory_order_acquire);
+        if(stamp != 2 * n + 2) {
+            return false;
+        }
+
+        std::uint64_t w[words];
+        for(std::size_t i = 0 ; i < words ; ++i) {
+            w[i] = s.words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
 
-    constexpr bool call(arg<B1> p1, arg<B2> p2) {
-        MM_CAST_2 { f_(*u1, *u2); return true; }
-        return false;
+        if(s.stamp_.load(std::memory_order_relaxed) != stamp) {
+            return false;
+        }
+
+        std::memcpy(&r, w, sizeof(r));
+        return true;
     }
-};
 
-/**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_3 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
-    const F f_;
-    constexpr explicit method_3(F f) : f_(f) {}
+    static std::mutex& registry_mutex() { static std::mutex r; return r; }
+    static std::vector<std::unique_ptr<trace_buffer>>& registry() { static std::vector<std::unique_ptr<trace_buffer>> r; return r; }
 
-    constexpr ret_t call(arg<B1> p1, arg<B2> p2, arg<B3> p3) {
-        MM_CAST_3 return ret_t { f_(*u1, *u2, *u3) };
-        return {};
+    // Buffer of the current thread, buffers of finished threads are reused.
+    static trace_buffer& local() {
+        static thread_local trace_buffer* buffer { nullptr };
+        if(!buffer) {
+            buffer = acquire();
+        }
+        return *buffer;
     }
-};
 
-/**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_3_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    const F f_;
-    constexpr explicit method_3_void(F f) : f_(f) {}
+    static trace_buffer* acquire() {
+        struct releaser final {
+            trace_buffer* buffer_;
+            ~releaser() { buffer_->used_.store(false, std::memory_order_release); }
+        };
 
-    constexpr bool call(arg<B1> p1, arg<B2> p2, arg<B3> p3) {
-        MM_CAST_3 { f_(*u1, *u2, *u3); return true; }
-        return false;
-    }
-};
+        std::lock_guard<std::mutex> lock(registry_mutex());
 
-/**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_4 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
-    const F f_;
-    constexpr explicit method_4(F f) : f_(f) {}
+        trace_buffer* r = nullptr;
+        for(auto& b : registry()) {
+            if(!b->used_.load(std::memory_order_acquire)) {
+                b->used_.store(true, std::memory_order_relaxed);
+                r = b.get();
+                break;
+            }
+        }
 
-    constexpr ret_t call(arg<B1> p1, arg<B2> p2, arg<B3> p3, arg<B4> p4) {
-        MM_CAST_4 return ret_t { f_(*u1, *u2, *u3, *u4) };
-        return {};
+        if(!r) {
+            registry().push_back(std::make_unique<trace_buffer>());
+            r = registry().back().get();
+        }
+
+        static thread_local releaser rel { r };
+        return r;
     }
 };
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_4_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    const F f_;
-    constexpr explicit method_4_void(F f) : f_(f) {}
-
-    constexpr bool call(arg<B1> p1, arg<B2> p2, arg<B3> p3, arg<B4> p4) {
-        MM_CAST_4 { f_(*u1, *u2, *u3, *u4); return true; }
-        return false;
+// Fills a trace record while a multimethod is dispatched and stores it on exit.
+//
+struct trace_scope final {
+    trace_record record_; // Not zeroed to be cheaper, unused 'types_' are left uninitialized.
+
+    trace_scope(int method, std::initializer_list<const std::type_info*> types) {
+        record_.time_ = timestamp();
+        record_.method_ = static_cast<std::uint16_t>(method);
+        record_.impl_ = -1;
+        record_.arity_ = static_cast<std::uint8_t>(types.size());
+        record_.probes_ = 0;
+        record_.next_ = 0;
+        record_.flags_ = 0;
+        std::copy(types.begin(), types.end(), record_.types_);
     }
+
+    ~trace_scope() { trace_buffer::local().push(record_); }
 };
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_5 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
-    const F f_;
-    constexpr explicit method_5(F f) : f_(f) {}
+} // namespace detail
 
-    constexpr ret_t call(arg<B1> p1, arg<B2> p2, arg<B3> p3, arg<B4> p4, arg<B5> p5) {
-        MM_CAST_5 return ret_t { f_(*u1, *u2, *u3, *u4, *u5) };
-        return {};
-    }
-};
+/**********************************************************************************************/
+// Name of a multimethod by id from a trace record.
+//
+inline const char* method_name(int id) {
+    const auto& methods = detail::method_info::methods();
+    return id >= 0 && id < static_cast<int>(methods.size()) ? methods[id]->name_ : "";
+}
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_5_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    const F f_;
-    constexpr explicit method_5_void(F f) : f_(f) {}
+// Moves all trace records collected so far to 'out', oldest first for each thread.
+// Returns count of added records. Can be called from any thread.
+//
+inline std::size_t drain_trace(std::vector<trace_record>& out) {
+    using detail::trace_buffer;
 
-    constexpr bool call(arg<B1> p1, arg<B2> p2, arg<B3> p3, arg<B4> p4, arg<B5> p5) {
-        MM_CAST_5 { f_(*u1, *u2, *u3, *u4, *u5); return true; }
-        return false;
-    }
-};
+    std::lock_guard<std::mutex> lock(trace_buffer::registry_mutex());
+    const std::size_t count = out.size();
 
-/**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_6 final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    using ret_t = typename abstract_method<T, B1, B2, B3, B4, B5, B6>::ret_t;
-    const F f_;
-    constexpr explicit method_6(F f) : f_(f) {}
+    for(auto& b : trace_buffer::registry()) {
+        const std::uint64_t head = b->head_.load(std::memory_order_acquire);
+        const std::uint64_t from = std::max(b->tail_, head > trace_buffer::size ? head - trace_buffer::size : 0);
 
-    constexpr ret_t call(arg<B1> p1, arg<B2> p2, arg<B3> p3, arg<B4> p4, arg<B5> p5, arg<B6> p6) {
-        MM_CAST_6 return ret_t { f_(*u1, *u2, *u3, *u4, *u5, *u6) };
-        return {};
+        // The owner could overwrite oldest records while we copy them
+        trace_record r;
+        for(std::uint64_t i = from ; i < head ; ++i) {
+            if(b->read(i, r)) {
+                out.push_back(r);
+            }
+        }
+
+        b->tail_ = head;
     }
-};
+
+    return out.size() - count;
+}
 
 /**********************************************************************************************/
-template<class T, class B1, class B2, class B3, class B4, class B5, class B6, class F>
-struct method_6_void final : abstract_method<T, B1, B2, B3, B4, B5, B6> {
-    const F f_;
-    constexpr explicit method_6_void(F f) : f_(f) {}
+// Drains trace records to a binary file:
+//
+//   "MMTRACE1"
+//   u32 count of methods, for each: u16 id, string name, u16 count of impls, strings impls' types
+//   u32 count of types, for each: string mangled name
+//   u64 count of records, for each: u64 time, u16 method, i8 impl, u8 probes, u8 next,
+//                                   u8 flags, u8 arity, u32 index of type for each argument
+//
+// where string is u16 length and characters without terminating zero.
+//
+inline bool dump_trace(const char* path) {
+    using detail::write_pod;
+    using detail::write_string;
+
+    std::vector<trace_record> records;
+    drain_trace(records);
 
-    constexpr bool call(arg<B1> p1, arg<B2> p2, arg<B3> p3, arg<B4> p4, arg<B5> p5, arg<B6> p6) {
-        MM_CAST_6 { f_(*u1, *u2, *u3, *u4, *u5, *u6); return true; }
+    std::FILE* f = std::fopen(path, "wb");
+    if(!f) {
         return false;
     }
-};
 
-/**********************************************************************************************/
-#undef MM_CAST_1
-#undef MM_CAST_2
-#undef MM_CAST_3
-#undef MM_CAST_4
-#undef MM_CAST_5
-#undef MM_CAST_6
+    std::fwrite("MMTRACE1", 1, 8, f);
 
+    const auto& methods = detail::method_info::methods();
+    write_pod(f, static_cast<std::uint32_t>(methods.size()));
+    for(auto m : methods) {
+        write_pod(f, static_cast<std::uint16_t>(m->id_));
+        write_string(f, m->name_);
+        write_pod(f, static_cast<std::uint16_t>(m->signatures_.size()));
+        for(auto t : m->signatures_) {
+            write_string(f, t->name());
+        }
+    }
 
-/**********************************************************************************************/
-template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline
-auto make_method(bool /*dummy*/) {
-    return nullptr;
-}
+    std::vector<const std::type_info*> types;
+    for(auto& r : records) {
+        for(int i = 0 ; i < r.arity_ ; ++i) {
+            if(std::find(types.begin(), types.end(), r.types_[i]) == types.end()) {
+                types.push_back(r.types_[i]);
+            }
+        }
+    }
 
-/**********************************************************************************************/
-#define MM_MAKE_METHOD(N) \
-    template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline \
-    auto make_method(F f) -> enable_if_t<function_traits<F>::arity == (N) && !is_same_v<void, typename function_traits<F>::ret_type>, abstract_method<T, B1, B2, B3, B4, B5, B6>*> { \
-        static_assert(function_traits<F>::arity == function_traits<P>::arity || is_same_v<typename function_traits<F>::arg1_type, fallback_t>, "Invalid count of implementation's parameters."); \
-        static_assert(check_parameters<P, F>::value, "Incompatible implementation's parameters types."); \
-        return new method_ ## N<T, B1, B2, B3, B4, B5, B6, F>(f); \
-    } \
-    \
-    template<class P, class T, class B1, class B2, class B3, class B4, class B5, class B6, class F> inline \
-    auto make_method(F f) -> enable_if_t<function_traits<F>::arity == (N) && is_same_v<void, typename function_traits<F>::ret_type>, abstract_method<T, B1, B2, B3, B4, B5, B6>*> { \
-        static_assert(function_traits<F>::arity == function_traits<P>::arity || is_same_v<typename function_traits<F>::arg1_type, fallback_t>, "Invalid count of implementation's parameters."); \
-        static_assert(check_parameters<P, F>::value, "Incompatible implementation's parameters types."); \
-        return new method_ ## N ## _void<T, B1, B2, B3, B4, B5, B6, F>(f); \
+    write_pod(f, static_cast<std::uint32_t>(types.size()));
+    for(auto t : types) {
+        write_string(f, t->name());
     }
 
-/**********************************************************************************************/
-MM_MAKE_METHOD(0)
-MM_MAKE_METHOD(1)
-MM_MAKE_METHOD(2)
-MM_MAKE_METHOD(3)
-MM_MAKE_METHOD(4)
-MM_MAKE_METHOD(5)
-MM_MAKE_METHOD(6)
+    write_pod(f, static_cast<std::uint64_t>(records.size()));
+    for(auto& r : records) {
+        write_pod(f, r.time_);
+        write_pod(f, r.method_);
+        write_pod(f, r.impl_);
+        write_pod(f, r.probes_);
+        write_pod(f, r.next_);
+        write_pod(f, r.flags_);
+        write_pod(f, r.arity_);
+        for(int i = 0 ; i < r.arity_ ; ++i) {
+            write_pod(f, static_cast<std::uint32_t>(std::find(types.begin(), types.end(), r.types_[i]) - types.begin()));
+        }
+    }
 
-/**********************************************************************************************/
-#undef MM_MAKE_METHOD
+    return std::fclose(f) == 0;
+}
 
+#endif // MM_ENABLE_TRACE
 
-/**********************************************************************************************/
-template<class T>
-struct method_result_impl {
-    static T unwrap(method_ret_type<T>& o) { return *o; }
-};
 
-/**********************************************************************************************/
-template<>
-struct method_result_impl<void> {
-    static void unwrap(bool /*v*/) {}
-};
+#ifdef MM_ENABLE_PROFILE
 
 /**********************************************************************************************/
-template<class T>
-struct method_result final : public method_result_impl<T> {
+// Copy of a histogram of durations, i-th bucket counts durations with i significant bits.
+//
+struct profile_stats final {
+    std::uint64_t count_ { 0 };
+    std::uint64_t sum_ { 0 };
+    std::uint64_t buckets_[detail::profile_histogram::size] {};
 };
 
-
 /**********************************************************************************************/
-template<std::size_t N, class T = void, class... Args>
-struct nth_type {
-    using type = typename nth_type<N - 1, Args...>::type;
+// Statistics of an implementation (or of a fallback handler), in ticks.
+//
+struct profile_entry final {
+    std::string method_;
+    std::string impl_;
+    profile_stats dispatch_; // From the entry to a dispatcher till selecting of the implementation.
+    profile_stats body_;     // Time of implementation's body, including 'next_method' hops.
 };
 
 /**********************************************************************************************/
-template<class T, class... Args>
-struct nth_type<0, T, Args...> {
-    using type = T;
-};
-
+namespace detail {
 
 /**********************************************************************************************/
-// Helper class to store and sort implementations.
+// Measures one call of a multimethod.
 //
-template<class... Funcs>
-struct method_impls final {
-    const std::tuple<bool, Funcs...> funcs_;
-    constexpr explicit method_impls( std::tuple<bool, Funcs...>&& funcs ) : funcs_(funcs) {}
+struct profile_scope final {
+    method_info& info_;
+    const std::uint64_t begin_;
+    const std::uint64_t prev_selected_; // To restore it after nested calls of multimethods.
+    std::uint64_t body_ { 0 };
+
+    explicit profile_scope(method_info& info)
+    : info_(info), begin_(timestamp()), prev_selected_(profile_selected()) {
+    }
 
-    static constexpr int N = sizeof...(Funcs);
-    static_assert(N < 65, "Too many implementations.");
+    ~profile_scope() { profile_selected() = prev_selected_; }
 
-    #define MM_FUNC_TYPE(I) \
-        using F ## I = typename nth_type<((I) < N ? (I) : 0), Funcs...>::type
+    void next() { body_ += profile_skipped() - profile_selected(); }
 
-    MM_FUNC_TYPE(0); MM_FUNC_TYPE(1); MM_FUNC_TYPE(2); MM_FUNC_TYPE(3);
-    MM_FUNC_TYPE(4); MM_FUNC_TYPE(5); MM_FUNC_TYPE(6); MM_FUNC_TYPE(7);
-    MM_FUNC_TYPE(8); MM_FUNC_TYPE(9); MM_FUNC_TYPE(10); MM_FUNC_TYPE(11);
-    MM_FUNC_TYPE(12); MM_FUNC_TYPE(13); MM_FUNC_TYPE(14); MM_FUNC_TYPE(15);
-    MM_FUNC_TYPE(16); MM_FUNC_TYPE(17); MM_FUNC_TYPE(18); MM_FUNC_TYPE(19);
-    MM_FUNC_TYPE(20); MM_FUNC_TYPE(21); MM_FUNC_TYPE(22); MM_FUNC_TYPE(23);
-    MM_FUNC_TYPE(24); MM_FUNC_TYPE(25); MM_FUNC_TYPE(26); MM_FUNC_TYPE(27);
-    MM_FUNC_TYPE(28); MM_FUNC_TYPE(29); MM_FUNC_TYPE(30); MM_FUNC_TYPE(31);
-    MM_FUNC_TYPE(32); MM_FUNC_TYPE(33); MM_FUNC_TYPE(34); MM_FUNC_TYPE(35);
-    MM_FUNC_TYPE(36); MM_FUNC_TYPE(37); MM_FUNC_TYPE(38); MM_FUNC_TYPE(39);
-    MM_FUNC_TYPE(40); MM_FUNC_TYPE(41); MM_FUNC_TYPE(42); MM_FUNC_TYPE(43);
-    MM_FUNC_TYPE(44); MM_FUNC_TYPE(45); MM_FUNC_TYPE(46); MM_FUNC_TYPE(47);
-    MM_FUNC_TYPE(48); MM_FUNC_TYPE(49); MM_FUNC_TYPE(50); MM_FUNC_TYPE(51);
-    MM_FUNC_TYPE(52); MM_FUNC_TYPE(53); MM_FUNC_TYPE(54); MM_FUNC_TYPE(55);
-    MM_FUNC_TYPE(56); MM_FUNC_TYPE(57); MM_FUNC_TYPE(58); MM_FUNC_TYPE(59);
-    MM_FUNC_TYPE(60); MM_FUNC_TYPE(61); MM_FUNC_TYPE(62); MM_FUNC_TYPE(63);
+    void done(int impl) {
+        const std::uint64_t end = timestamp();
+        body_ += end - profile_selected();
 
-    #undef MM_FUNC_TYPE
+        impl_profile& p = info_.profile_[impl];
+        p.dispatch_.add(end - begin_ - body_);
+        p.body_.add(body_);
+    }
+};
 
-    // Predicate function to sort functions
-    template<class A>
-    static constexpr bool pred_b(int b) {
-        #define MM_CASE_B(I) \
-            if(b == (I)) return compare_functions<A, F ## I>::value < 0;
+/**********************************************************************************************/
+inline profile_stats copy_stats(profile_histogram& h, bool reset) {
+    profile_stats r;
+
+    if(reset) {
+        r.count_ = h.count_.exchange(0, std::memory_order_relaxed);
+        r.sum_ = h.sum_.exchange(0, std::memory_order_relaxed);
+        for(int i = 0 ; i < profile_histogram::size ; ++i) {
+            r.buckets_[i] = h.buckets_[i].exchange(0, std::memory_order_relaxed);
+        }
+    } else {
+        r.count_ = h.count_.load(std::memory_order_relaxed);
+        r.sum_ = h.sum_.load(std::memory_order_relaxed);
+        for(int i = 0 ; i < profile_histogram::size ; ++i) {
+            r.buckets_[i] = h.buckets_[i].load(std::memory_order_relaxed);
+        }
+    }
 
-        MM_CASE_B(0); MM_CASE_B(1); MM_CASE_B(2); MM_CASE_B(3);
-        MM_CASE_B(4); MM_CASE_B(5); MM_CASE_B(6); MM_CASE_B(7);
-        MM_CASE_B(8); MM_CASE_B(9); MM_CASE_B(10); MM_CASE_B(11);
-        MM_CASE_B(12); MM_CASE_B(13); MM_CASE_B(14); MM_CASE_B(15);
-        MM_CASE_B(16); MM_CASE_B(17); MM_CASE_B(18); MM_CASE_B(19);
-        MM_CASE_B(20); MM_CASE_B(21); MM_CASE_B(22); MM_CASE_B(23);
-        MM_CASE_B(24); MM_CASE_B(25); MM_CASE_B(26); MM_CASE_B(27);
-        MM_CASE_B(28); MM_CASE_B(29); MM_CASE_B(30); MM_CASE_B(31);
-        MM_CASE_B(32); MM_CASE_B(33); MM_CASE_B(34); MM_CASE_B(35);
-        MM_CASE_B(36); MM_CASE_B(37); MM_CASE_B(38); MM_CASE_B(39);
-        MM_CASE_B(40); MM_CASE_B(41); MM_CASE_B(42); MM_CASE_B(43);
-        MM_CASE_B(44); MM_CASE_B(45); MM_CASE_B(46); MM_CASE_B(47);
-        MM_CASE_B(48); MM_CASE_B(49); MM_CASE_B(50); MM_CASE_B(51);
-        MM_CASE_B(52); MM_CASE_B(53); MM_CASE_B(54); MM_CASE_B(55);
-        MM_CASE_B(56); MM_CASE_B(57); MM_CASE_B(58); MM_CASE_B(59);
-        MM_CASE_B(60); MM_CASE_B(61); MM_CASE_B(62); MM_CASE_B(63);
+    return r;
+}
 
-        #undef MM_CASE_B
+/**********************************************************************************************/
+} // namespace detail
 
-        return false;
-    }
+/**********************************************************************************************/
+// Returns statistics of all called implementations, optionally resets them.
+//
+inline std::vector<profile_entry> profile_snapshot(bool reset = false) {
+    std::vector<profile_entry> r;
 
-    // Sorts functions and returns array with instances of 'abstract_method'
-    // TODO(I.N.): constexpr
-    template<class TP, class TR, class BR1, class BR2, class BR3, class BR4, class BR5, class BR6>
-    auto to_array() const {
-        // Use indexes cause we cannot sort tuple itself
-        array<int, N> indexes {};
-        for(int i = 0 ; i < N ; ++i) {
-            indexes[i] = i;
-        }
-
-        // Sort functions
-        sort(indexes.begin(), indexes.end(), [](int a, int b) {
-            #define MM_CASE_A(I) \
-                if(a == (I)) return method_impls::pred_b<F ## I>(b)
-
-            MM_CASE_A(0); MM_CASE_A(1); MM_CASE_A(2); MM_CASE_A(3);
-            MM_CASE_A(4); MM_CASE_A(5); MM_CASE_A(6); MM_CASE_A(7);
-            MM_CASE_A(8); MM_CASE_A(9); MM_CASE_A(10); MM_CASE_A(11);
-            MM_CASE_A(12); MM_CASE_A(13); MM_CASE_A(14); MM_CASE_A(15);
-            MM_CASE_A(16); MM_CASE_A(17); MM_CASE_A(18); MM_CASE_A(19);
-            MM_CASE_A(20); MM_CASE_A(21); MM_CASE_A(22); MM_CASE_A(23);
-            MM_CASE_A(24); MM_CASE_A(25); MM_CASE_A(26); MM_CASE_A(27);
-            MM_CASE_A(28); MM_CASE_A(29); MM_CASE_A(30); MM_CASE_A(31);
-            MM_CASE_A(32); MM_CASE_A(33); MM_CASE_A(34); MM_CASE_A(35);
-            MM_CASE_A(36); MM_CASE_A(37); MM_CASE_A(38); MM_CASE_A(39);
-            MM_CASE_A(40); MM_CASE_A(41); MM_CASE_A(42); MM_CASE_A(43);
-            MM_CASE_A(44); MM_CASE_A(45); MM_CASE_A(46); MM_CASE_A(47);
-            MM_CASE_A(48); MM_CASE_A(49); MM_CASE_A(50); MM_CASE_A(51);
-            MM_CASE_A(52); MM_CASE_A(53); MM_CASE_A(54); MM_CASE_A(55);
-            MM_CASE_A(56); MM_CASE_A(57); MM_CASE_A(58); MM_CASE_A(59);
-            MM_CASE_A(60); MM_CASE_A(61); MM_CASE_A(62); MM_CASE_A(63);
-
-            #undef MM_CASE_A
-
-            return a < b;
-        } );
+    for(auto m : detail::method_info::methods()) {
+        if(!m->profile_) {
+            continue;
+        }
 
-        // Create and fill array with implementations
-        array<abstract_method<TR, BR1, BR2, BR3, BR4, BR5, BR6>*, N> r {};
+        for(std::size_t i = 0 ; i <= m->signatures_.size() ; ++i) {
+            auto& p = m->profile_[i];
+            if(!p.dispatch_.count_.load(std::memory_order_relaxed)) {
+                continue;
+            }
 
-        for(int i = 0 ; i < N ; ++i) {
-            switch(indexes[i]) {
-                #define MM_FILL_VECTOR(I) \
-                    case I: r[i] = make_method<TP, TR, BR1, BR2, BR3, BR4, BR5, BR6, F ## I>(std::get<(I) < N ? (I) + 1 : 0>(funcs_)); break
+            profile_entry e;
+            e.method_ = m->name_;
+            e.impl_ = i < m->signatures_.size() ? detail::type_name(*m->signatures_[i]) : "fallback";
+            e.dispatch_ = detail::copy_stats(p.dispatch_, reset);
+            e.body_ = detail::copy_stats(p.body_, reset);
+            r.push_back(std::move(e));
+        }
+    }
 
-                MM_FILL_VECTOR(0); MM_FILL_VECTOR(1); MM_FILL_VECTOR(2); MM_FILL_VECTOR(3);
-                MM_FILL_VECTOR(4); MM_FILL_VECTOR(5); MM_FILL_VECTOR(6); MM_FILL_VECTOR(7);
-                MM_FILL_VECTOR(8); MM_FILL_VECTOR(9); MM_FILL_VECTOR(10); MM_FILL_VECTOR(11);
-                MM_FILL_VECTOR(12); MM_FILL_VECTOR(13); MM_FILL_VECTOR(14); MM_FILL_VECTOR(15);
-                MM_FILL_VECTOR(16); MM_FILL_VECTOR(17); MM_FILL_VECTOR(18); MM_FILL_VECTOR(19);
-                MM_FILL_VECTOR(20); MM_FILL_VECTOR(21); MM_FILL_VECTOR(22); MM_FILL_VECTOR(23);
-                MM_FILL_VECTOR(24); MM_FILL_VECTOR(25); MM_FILL_VECTOR(26); MM_FILL_VECTOR(27);
-                MM_FILL_VECTOR(28); MM_FILL_VECTOR(29); MM_FILL_VECTOR(30); MM_FILL_VECTOR(31);
-                MM_FILL_VECTOR(32); MM_FILL_VECTOR(33); MM_FILL_VECTOR(34); MM_FILL_VECTOR(35);
-                MM_FILL_VECTOR(36); MM_FILL_VECTOR(37); MM_FILL_VECTOR(38); MM_FILL_VECTOR(39);
-                MM_FILL_VECTOR(40); MM_FILL_VECTOR(41); MM_FILL_VECTOR(42); MM_FILL_VECTOR(43);
-                MM_FILL_VECTOR(44); MM_FILL_VECTOR(45); MM_FILL_VECTOR(46); MM_FILL_VECTOR(47);
-                MM_FILL_VECTOR(48); MM_FILL_VECTOR(49); MM_FILL_VECTOR(50); MM_FILL_VECTOR(51);
-                MM_FILL_VECTOR(52); MM_FILL_VECTOR(53); MM_FILL_VECTOR(54); MM_FILL_VECTOR(55);
-                MM_FILL_VECTOR(56); MM_FILL_VECTOR(57); MM_FILL_VECTOR(58); MM_FILL_VECTOR(59);
-                MM_FILL_VECTOR(60); MM_FILL_VECTOR(61); MM_FILL_VECTOR(62); MM_FILL_VECTOR(63);
+    return r;
+}
 
-                #undef MM_FILL_VECTOR
+/**********************************************************************************************/
+// Writes statistics to a CSV file with lines:
+//
+//   method;implementation;dispatch|body;count;sum;bucket0;...;bucket47
+//
+inline bool dump_profile(const char* path, bool reset = false) {
+    std::FILE* f = std::fopen(path, "w");
+    if(!f) {
+        return false;
+    }
 
-                default:;
-            }
+    auto write = [f](const profile_entry& e, const char* kind, const profile_stats& s) {
+        std::fprintf(f, "%s;%s;%s;%llu;%llu", e.method_.c_str(), e.impl_.c_str(), kind,
+                     static_cast<unsigned long long>(s.count_), static_cast<unsigned long long>(s.sum_));
+        for(auto b : s.buckets_) {
+            std::fprintf(f, ";%llu", static_cast<unsigned long long>(b));
         }
+        std::fputc('\n', f);
+    };
 
-        return r;
+    for(auto& e : profile_snapshot(reset)) {
+        write(e, "dispatch", e.dispatch_);
+        write(e, "body", e.body_);
     }
-};
+
+    return std::fclose(f) == 0;
+}
+
+#endif // MM_ENABLE_PROFILE
 
 
 /**********************************************************************************************/
-} // namespace detail
 } // namespace multimethods
 
 #endif // H_IN_MULTIMETHODS